@@ -24,7 +24,30 @@ SOURCES += main.cpp\
     dictionarythread.cpp \
     stereocalibrationdialog.cpp \
     calibrationthread.cpp \
-    disparitythread.cpp
+    disparitythread.cpp \
+    stereocalibration.cpp \
+    framering.cpp \
+    capturethread.cpp \
+    stereocapture.cpp \
+    framepool.cpp \
+    stereoframe.cpp \
+    framewidget.cpp \
+    depthstatistics.cpp \
+    depthengine.cpp \
+    depthworker.cpp \
+    sparsestereo.cpp \
+    parallelstereo.cpp \
+    pyramidstereo.cpp \
+    obstaclegrid.cpp \
+    proximitythread.cpp \
+    distancetracker.cpp \
+    chessboardthread.cpp \
+    onlinecalibrationthread.cpp \
+    grayremap.cpp \
+    taskscheduler.cpp \
+    scheduledtask.cpp \
+    adaptivesurfdetector.cpp \
+    streamingtask.cpp
 
 HEADERS  += mainwindow.h \
     categorizerthread.h \
@@ -35,7 +58,30 @@ HEADERS  += mainwindow.h \
     dictionarythread.h \
     stereocalibrationdialog.h \
     calibrationthread.h \
-    disparitythread.h
+    disparitythread.h \
+    stereocalibration.h \
+    framering.h \
+    capturethread.h \
+    stereocapture.h \
+    framepool.h \
+    stereoframe.h \
+    framewidget.h \
+    depthstatistics.h \
+    depthengine.h \
+    depthworker.h \
+    sparsestereo.h \
+    parallelstereo.h \
+    pyramidstereo.h \
+    obstaclegrid.h \
+    proximitythread.h \
+    distancetracker.h \
+    chessboardthread.h \
+    onlinecalibrationthread.h \
+    grayremap.h \
+    taskscheduler.h \
+    scheduledtask.h \
+    adaptivesurfdetector.h \
+    streamingtask.h
 
 FORMS    += mainwindow.ui \
     dictionarydialog.ui \
@@ -52,6 +98,7 @@ LIBS += -LE:/opencv/build/x86/vc11/lib/ \
     -lopencv_imgproc246 \
     -lopencv_features2d246 \
     -lopencv_calib3d246 \
+    -lopencv_video246 \
     -lopencv_ml246 \
     -lopencv_nonfree246 \
     -lopencv_flann246 \
@@ -0,0 +1,159 @@
+#include "adaptivesurfdetector.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Keypoints detected per kept one, so suppression has a choice in every cell
+static const double oversampling = 1.5;
+// Fraction of the log ratio between detected and wanted count corrected per frame
+static const double thresholdGain = 0.5;
+static const double minHessianThreshold = 10.0;
+static const double maxHessianThreshold = 20000.0;
+
+static bool strongerResponse(const cv::KeyPoint &a, const cv::KeyPoint &b)
+{
+    return a.response > b.response;
+}
+
+AdaptiveSurfDetector::AdaptiveSurfDetector(int targetKeypoints, cv::Size grid)
+{
+    adaptive = true;
+    this->targetKeypoints = std::max(1, targetKeypoints);
+    this->grid = grid;
+    hessianThreshold = defaultHessianThreshold;
+}
+
+void AdaptiveSurfDetector::detect(const cv::Mat &gray, std::vector<cv::KeyPoint> &keypoints)
+{
+    // Settings of this frame, other threads may detect and change them meanwhile
+    mutex.lock();
+    bool adaptiveFrame = adaptive;
+    double threshold = adaptive ? hessianThreshold : defaultHessianThreshold;
+    int target = targetKeypoints;
+    cv::Size cells = grid;
+    mutex.unlock();
+
+    cv::SurfFeatureDetector detector(threshold);
+    detector.detect(gray, keypoints);
+    if(!adaptiveFrame)
+    {
+        return;
+    }
+
+    // The count falls roughly in proportion to the threshold, correct part of the error in log space.
+    // The correction starts from the threshold this frame was detected with, frames detected at the same
+    // time measure the same error and must not each apply it on top of the others
+    double wanted = target * oversampling;
+    double ratio = keypoints.empty() ? 0.25 : std::max(0.25, std::min(4.0, keypoints.size() / wanted));
+    mutex.lock();
+    if(adaptive)
+    {
+        hessianThreshold = std::max(minHessianThreshold,
+                                    std::min(maxHessianThreshold, threshold * std::pow(ratio, thresholdGain)));
+    }
+    mutex.unlock();
+
+    bucket(keypoints, gray.size(), cells, target);
+}
+
+bool AdaptiveSurfDetector::isAdaptive() const
+{
+    QMutexLocker locker(&mutex);
+    return adaptive;
+}
+
+void AdaptiveSurfDetector::setAdaptive(bool value)
+{
+    QMutexLocker locker(&mutex);
+    adaptive = value;
+}
+
+int AdaptiveSurfDetector::getTargetKeypoints() const
+{
+    QMutexLocker locker(&mutex);
+    return targetKeypoints;
+}
+
+void AdaptiveSurfDetector::setTargetKeypoints(int value)
+{
+    QMutexLocker locker(&mutex);
+    targetKeypoints = std::max(1, value);
+}
+
+cv::Size AdaptiveSurfDetector::getGrid() const
+{
+    QMutexLocker locker(&mutex);
+    return grid;
+}
+
+void AdaptiveSurfDetector::setGrid(cv::Size value)
+{
+    QMutexLocker locker(&mutex);
+    grid = cv::Size(std::max(1, value.width), std::max(1, value.height));
+}
+
+double AdaptiveSurfDetector::getHessianThreshold() const
+{
+    QMutexLocker locker(&mutex);
+    return hessianThreshold;
+}
+
+void AdaptiveSurfDetector::bucket(std::vector<cv::KeyPoint> &keypoints, cv::Size imageSize, cv::Size grid,
+                                  int target) const
+{
+    if((int)keypoints.size() <= target || imageSize.area() == 0)
+    {
+        return;
+    }
+
+    std::sort(keypoints.begin(), keypoints.end(), strongerResponse);
+
+    // Strongest keypoints of every cell up to an equal share of the target. A keypoint closer than the
+    // spacing of an evenly filled cell to a stronger one kept in its cell is suppressed
+    int cells = grid.area();
+    int quota = (target + cells - 1) / cells;
+    double cellArea = (double)imageSize.area() / cells;
+    double minDistance = 0.5 * std::sqrt(cellArea / quota);
+    std::vector<std::vector<int> > cellKept(cells);
+    std::vector<uchar> kept(keypoints.size(), 0);
+    std::vector<uchar> suppressed(keypoints.size(), 0);
+    int total = 0;
+    for(size_t i = 0; i < keypoints.size() && total < target; i++)
+    {
+        int cx = std::min(grid.width - 1, std::max(0, (int)(keypoints[i].pt.x * grid.width / imageSize.width)));
+        int cy = std::min(grid.height - 1, std::max(0, (int)(keypoints[i].pt.y * grid.height / imageSize.height)));
+        std::vector<int> &cell = cellKept[cy * grid.width + cx];
+        for(size_t j = 0; j < cell.size() && !suppressed[i]; j++)
+        {
+            cv::Point2f d = keypoints[i].pt - keypoints[cell[j]].pt;
+            suppressed[i] = d.dot(d) < minDistance * minDistance;
+        }
+        if(!suppressed[i] && (int)cell.size() < quota)
+        {
+            cell.push_back(i);
+            kept[i] = 1;
+            total++;
+        }
+    }
+
+    // Cells without texture leave budget, spend it on the strongest keypoints left
+    for(size_t i = 0; i < keypoints.size() && total < target; i++)
+    {
+        if(!kept[i] && !suppressed[i])
+        {
+            kept[i] = 1;
+            total++;
+        }
+    }
+
+    std::vector<cv::KeyPoint> selected;
+    selected.reserve(total);
+    for(size_t i = 0; i < keypoints.size(); i++)
+    {
+        if(kept[i])
+        {
+            selected.push_back(keypoints[i]);
+        }
+    }
+    keypoints.swap(selected);
+}
@@ -0,0 +1,55 @@
+#ifndef ADAPTIVESURFDETECTOR_H
+#define ADAPTIVESURFDETECTOR_H
+
+//Qt
+#include <QMutex>
+#include <QMutexLocker>
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <opencv2/nonfree/features2d.hpp>
+
+#include <vector>
+
+// Hessian threshold of the templates, the training images and the fixed detector mode
+static const double defaultHessianThreshold = 500.0;
+
+/* SURF detector holding a target number of keypoints per frame.
+ * Every frame is detected with the threshold left by the previous ones, and its own threshold is then scaled
+ * towards the count that gives the target after suppression. The strongest keypoints are kept per grid cell
+ * first so they stay spread over the image, with non-maximum suppression of close keypoints within a cell.
+ * The remaining budget goes to the strongest of the rest.
+ * In fixed mode it is a plain SURF detector with defaultHessianThreshold. Safe to use from several threads. */
+class AdaptiveSurfDetector
+{
+public:
+
+    AdaptiveSurfDetector(int targetKeypoints = 400, cv::Size grid = cv::Size(4, 4));
+
+    void detect(const cv::Mat &gray, std::vector<cv::KeyPoint> &keypoints);
+
+    bool isAdaptive() const;
+    void setAdaptive(bool value);
+
+    int getTargetKeypoints() const;
+    void setTargetKeypoints(int value);
+
+    cv::Size getGrid() const;
+    void setGrid(cv::Size value);
+
+    double getHessianThreshold() const; //threshold the next frame is detected with
+
+private:
+
+    mutable QMutex mutex;
+    bool adaptive;
+    int targetKeypoints;
+    cv::Size grid;
+    double hessianThreshold;
+
+    void bucket(std::vector<cv::KeyPoint> &keypoints, cv::Size imageSize, cv::Size grid, int target) const;
+
+};
+
+#endif // ADAPTIVESURFDETECTOR_H
@@ -3,49 +3,119 @@
 
 #include <QDebug>
 
-CalibrationThread::CalibrationThread(QString calibDir, cv::Size patternSize, float sideLength)
+#include <algorithm>
+
+/* Decodes and detects the chessboard in a range of calibration images, left images first, then right ones.
+ * Every image writes only its own slot of the result vectors and is released as soon as its corners are
+ * known, so only one image per worker is held in memory and decoding overlaps detection on the other workers. */
+class ChessboardDetection : public cv::ParallelLoopBody
 {
-    this->calibDir = calibDir;
-    this->patternSize = patternSize;
-    this->sideLength = sideLength;
+public:
+
+    ChessboardDetection(const QStringList &filesLeft, const QStringList &filesRight, cv::Size patternSize,
+                        std::vector<std::vector<cv::Point2f> > &cornersLeft,
+                        std::vector<std::vector<cv::Point2f> > &cornersRight,
+                        std::vector<uchar> &foundLeft, std::vector<uchar> &foundRight,
+                        std::vector<cv::Size> &imageSizes) :
+        filesLeft(filesLeft), filesRight(filesRight), patternSize(patternSize), cornersLeft(cornersLeft),
+        cornersRight(cornersRight), foundLeft(foundLeft), foundRight(foundRight), imageSizes(imageSizes)
+    {
+    }
 
-    progressCounter = 0;
+    void operator()(const cv::Range &range) const
+    {
+        for(int i = range.start; i < range.end; i++)
+        {
+            bool left = i < filesLeft.size();
+            int index = left ? i : i - filesLeft.size();
+            const QString &file = left ? filesLeft[index] : filesRight[index];
+
+            // Corners are found on grayscale, decode straight into it
+            cv::Mat gray = cv::imread(file.toStdString(), CV_LOAD_IMAGE_GRAYSCALE);
+            if(gray.empty())
+            {
+                continue;
+            }
+            imageSizes[i] = gray.size();
+
+            std::vector<cv::Point2f> &corners = left ? cornersLeft[index] : cornersRight[index];
+            bool found = findChessboard(gray, patternSize, corners);
+            (left ? foundLeft[index] : foundRight[index]) = found ? 1 : 0;
+        }
+    }
 
-    doStop = false;
-}
+private:
 
-void CalibrationThread::stop()
-{
-    QMutexLocker locker(&doStopMutex);
-    doStop = true;
-}
+    const QStringList &filesLeft, &filesRight;
+    cv::Size patternSize;
+    std::vector<std::vector<cv::Point2f> > &cornersLeft, &cornersRight;
+    std::vector<uchar> &foundLeft, &foundRight;
+    std::vector<cv::Size> &imageSizes;
+};
 
-void CalibrationThread::run()
+/* Calibration of one camera from the corners it found, see CalibrationThread::singleCameraCalibration(). */
+class CalibrationThread::CameraCalibration : public Task
 {
-    doStopMutex.lock();
-    if(doStop)
+public:
+
+    CameraCalibration(CalibrationThread *calibration, const QString &camera, cv::Mat &cameraMatrix, cv::Mat &distCoeffs,
+                      const std::vector<std::vector<cv::Point2f> > &corners, const std::vector<uchar> &found) :
+        Task(Task::Background), calibration(calibration), camera(camera), cameraMatrix(cameraMatrix),
+        distCoeffs(distCoeffs), corners(corners), found(found)
     {
-        doStop = false;
-        doStopMutex.unlock();
     }
-    doStopMutex.unlock();
 
-    processingMutex.lock();
+protected:
 
-    //Right camera calibration
-    loadImages("Right", imagesRight);
-    calcImagePoints(imagePointsRight, imagesRight);
-    singleCameraCalibration("right", cameraMatrixRight, distCoeffsRight, imagePointsRight, imagesRight);
+    void run()
+    {
+        std::vector<std::vector<cv::Point3f> > objectPoints;
+        std::vector<std::vector<cv::Point2f> > imagePoints;
+        calibration->calcImagePoints(objectPoints, imagePoints, corners, found);
+        calibration->singleCameraCalibration(camera, cameraMatrix, distCoeffs, objectPoints, imagePoints);
+    }
+
+private:
+
+    CalibrationThread *calibration;
+    QString camera;
+    cv::Mat &cameraMatrix, &distCoeffs; //members of the waiting CalibrationThread
+    const std::vector<std::vector<cv::Point2f> > &corners;
+    const std::vector<uchar> &found;
+};
+
+CalibrationThread::CalibrationThread(QString calibDir, cv::Size patternSize, float sideLength) :
+    ScheduledTask(Task::Background)
+{
+    this->calibDir = calibDir;
+    this->patternSize = patternSize;
+    this->sideLength = sideLength;
+
+    progressCounter = 0;
+    imageSize = cv::Size(0, 0);
+}
+
+void CalibrationThread::run()
+{
+    //Chessboard corners of all images of both cameras, detected once
+    listImages("Right", filesRight);
+    listImages("Left", filesLeft);
+    detectCorners();
     progressCounter  = 25;
     emit updateProgress(progressCounter);
 
-    objectPoints.clear();
+    //Right and left camera calibrations run in parallel, this task helps while waiting for them
+    TaskPtr right(new CameraCalibration(this, "right", cameraMatrixRight, distCoeffsRight, cornersRight, foundRight));
+    TaskPtr left(new CameraCalibration(this, "left", cameraMatrixLeft, distCoeffsLeft, cornersLeft, foundLeft));
+    TaskScheduler::instance()->submit(right);
+    TaskScheduler::instance()->submit(left);
 
-    //Left camera calibration
-    loadImages("Left", imagesLeft);
-    calcImagePoints(imagePointsLeft, imagesLeft);
-    singleCameraCalibration("left", cameraMatrixLeft, distCoeffsLeft, imagePointsLeft, imagesLeft);
-    progressCounter  = 50;
+    TaskScheduler::instance()->wait(right);
+    progressCounter  = 40;
+    emit updateProgress(progressCounter);
+
+    TaskScheduler::instance()->wait(left);
+    progressCounter  = 55;
     emit updateProgress(progressCounter);
 
     objectPoints.clear();
@@ -63,15 +133,13 @@ void CalibrationThread::run()
     progressCounter  = 100;
     emit updateProgress(progressCounter);
 
-    processingMutex.unlock();
-
     //Inform GUI of rectification data
-    emit sendRectificationData(map_l1, map_l2, map_r1, map_r2, Q);
+    emit sendRectificationData(calibration);
 
 
 }
 
-void CalibrationThread::loadImages(QString camera, QList<cv::Mat> &images)
+void CalibrationThread::listImages(QString camera, QStringList &files)
 {
 
     QDir calibDirectory(calibDir + camera);
@@ -81,48 +149,40 @@ void CalibrationThread::loadImages(QString camera, QList<cv::Mat> &images)
     while(it.hasNext())
     {
         it.next();
-        images.push_back(cv::imread(it.fileInfo().absoluteFilePath().toStdString()));
+        files.push_back(it.fileInfo().absoluteFilePath());
     }
 
+    // Left and right images are paired by position, keep the order independent of the file system
+    files.sort();
+
 }
 
-void CalibrationThread::calcImagePoints(std::vector<std::vector<cv::Point2f> > &imagePoints,
-                                        QList<cv::Mat> &images)
+void CalibrationThread::detectCorners()
 {
-    // Calculate the object points in the object co-ordinate system (origin at top left corner)
-    std::vector<cv::Point3f> objPoints;
-    for(int i = 0; i < patternSize.height; i++)
-    {
-        for(int j = 0; j < patternSize.width; j++)
-        {
-            objPoints.push_back(cv::Point3f(j * sideLength, i * sideLength, 0.f));
-        }
-    }
+    int views = filesLeft.size() + filesRight.size();
 
-    for(int i = 0; i < images.size(); i++)
+    cornersLeft.assign(filesLeft.size(), std::vector<cv::Point2f>());
+    cornersRight.assign(filesRight.size(), std::vector<cv::Point2f>());
+    foundLeft.assign(filesLeft.size(), 0);
+    foundRight.assign(filesRight.size(), 0);
+    std::vector<cv::Size> imageSizes(views, cv::Size(0, 0));
+
+    // Images are independent, decode and detect all of them across the available cores
+    TaskScheduler::instance()->parallelFor(cv::Range(0, views),
+                                           ChessboardDetection(filesLeft, filesRight, patternSize, cornersLeft,
+                                                               cornersRight, foundLeft, foundRight, imageSizes));
+
+    for(int i = 0; i < views; i++)
     {
-        cv::Mat im = images[i];
-        std::vector<cv::Point2f> imPoints;
-
-        //Find chessboard corners
-        bool patternFound = cv::findChessboardCorners(im, patternSize, imPoints,
-                                                      cv::CALIB_CB_ADAPTIVE_THRESH +
-                                                      cv::CALIB_CB_NORMALIZE_IMAGE +
-                                                      cv::CALIB_CB_FAST_CHECK);
-        if(patternFound)
+        if(imageSizes[i].area() > 0)
         {
-            objectPoints.push_back(objPoints);
-            cv::Mat gray;
-            cv::cvtColor(im, gray, CV_BGR2GRAY);
-            cv::cornerSubPix(gray, imPoints, cv::Size(5,5), cv::Size(-1, -1),
-                             cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1));
-            imagePoints.push_back(imPoints);
+            imageSize = imageSizes[i];
+            break;
         }
-
     }
 }
 
-void CalibrationThread::calcImagePointsStereo()
+std::vector<cv::Point3f> CalibrationThread::boardPoints() const
 {
     // Calculate the object points in the object co-ordinate system (origin at top left corner)
     std::vector<cv::Point3f> objPoints;
@@ -133,50 +193,57 @@ void CalibrationThread::calcImagePointsStereo()
             objPoints.push_back(cv::Point3f(j * sideLength, i * sideLength, 0.f));
         }
     }
+    return objPoints;
+}
+
+void CalibrationThread::calcImagePoints(std::vector<std::vector<cv::Point3f> > &objectPoints,
+                                        std::vector<std::vector<cv::Point2f> > &imagePoints,
+                                        const std::vector<std::vector<cv::Point2f> > &corners,
+                                        const std::vector<uchar> &found) const
+{
+    std::vector<cv::Point3f> objPoints = boardPoints();
 
-    for(int i = 0; i < imagesLeft.size(); i++)
+    for(size_t i = 0; i < corners.size(); i++)
     {
-        cv::Mat lim = imagesLeft[i];
-        cv::Mat rim = imagesRight[i];
-
-        std::vector<cv::Point2f> imPointsLeft, imPointsRight;
-
-        bool patternFoundLeft = cv::findChessboardCorners(lim, patternSize, imPointsLeft,
-                                                      cv::CALIB_CB_ADAPTIVE_THRESH +
-                                                      cv::CALIB_CB_NORMALIZE_IMAGE +
-                                                      cv::CALIB_CB_FAST_CHECK);
-        bool patternFoundRight = cv::findChessboardCorners(rim, patternSize, imPointsRight,
-                                                      cv::CALIB_CB_ADAPTIVE_THRESH +
-                                                      cv::CALIB_CB_NORMALIZE_IMAGE +
-                                                      cv::CALIB_CB_FAST_CHECK);
-        if(patternFoundLeft && patternFoundRight)
+        if(found[i])
         {
             objectPoints.push_back(objPoints);
-            cv::Mat gray;
-            cv::cvtColor(lim, gray, CV_BGR2GRAY);
-            cv::cornerSubPix(gray, imPointsLeft, cv::Size(5,5), cv::Size(-1, -1),
-                             cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1));
-            cv::cvtColor(rim, gray, CV_BGR2GRAY);
-            cv::cornerSubPix(gray, imPointsRight, cv::Size(5,5), cv::Size(-1, -1),
-                             cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1));
-            imagePointsLeft.push_back(imPointsLeft);
-            imagePointsRight.push_back(imPointsRight);
+            imagePoints.push_back(corners[i]);
         }
-        else
+    }
+}
+
+void CalibrationThread::calcImagePointsStereo()
+{
+    std::vector<cv::Point3f> objPoints = boardPoints();
+
+    // Left and right images are paired by their position in the directories, only pairs seen by both cameras count
+    size_t pairs = std::min(cornersLeft.size(), cornersRight.size());
+    for(size_t i = 0; i < pairs; i++)
+    {
+        if(foundLeft[i] && foundRight[i])
         {
-            imagesLeft.erase(imagesLeft.begin() + i);
-            imagesRight.erase(imagesRight.begin() + i);
+            objectPoints.push_back(objPoints);
+            imagePointsLeft.push_back(cornersLeft[i]);
+            imagePointsRight.push_back(cornersRight[i]);
         }
     }
 
 }
 
 void CalibrationThread::singleCameraCalibration(QString camera, cv::Mat &cameraMatrix, cv::Mat &distCoeffs,
-                                                std::vector<std::vector<cv::Point2f> > imagePoints, QList<cv::Mat> images)
+                                                const std::vector<std::vector<cv::Point3f> > &objectPoints,
+                                                const std::vector<std::vector<cv::Point2f> > &imagePoints)
 {
+    if(imagePoints.empty())
+    {
+        emit sendMessage("No chessboard found in the " + camera + " camera images");
+        return;
+    }
+
     std::vector<cv::Mat> rvecs, tvecs;
 
-    float rmsError = cv::calibrateCamera(objectPoints, imagePoints, images[0].size(),
+    float rmsError = cv::calibrateCamera(objectPoints, imagePoints, imageSize,
                                          cameraMatrix, distCoeffs, rvecs, tvecs);
 
     QString fileName = calibDir + camera + "_calib.xml";
@@ -189,22 +256,12 @@ void CalibrationThread::singleCameraCalibration(QString camera, cv::Mat &cameraM
 
 void CalibrationThread::stereoCalibration()
 {
-    if(!cameraMatrixLeft.empty() && !distCoeffsLeft.empty() && !cameraMatrixRight.empty() && !distCoeffsRight.empty())
+    if(!cameraMatrixLeft.empty() && !distCoeffsLeft.empty() && !cameraMatrixRight.empty() && !distCoeffsRight.empty() &&
+       !objectPoints.empty())
     {
         double rms = cv::stereoCalibrate(objectPoints, imagePointsLeft, imagePointsRight,
                                          cameraMatrixLeft, distCoeffsLeft, cameraMatrixRight, distCoeffsRight,
-                                         imagesLeft[0].size(), R, T, E, F);
-        QString fileName = calibDir + "stereo_calib.xml";
-        cv::FileStorage fs(fileName.toStdString(), cv::FileStorage::WRITE);
-        fs << "cameraMatrixLeft" << cameraMatrixLeft;
-        fs << "cameraMatrixRight" << cameraMatrixRight;
-        fs << "distCoeffsLeft" << distCoeffsLeft;
-        fs << "distCoeffsRight" << distCoeffsRight;
-        fs << "R" << R;
-        fs << "T" << T;
-        fs << "E" << E;
-        fs << "F" << F;
-        fs.release();
+                                         imageSize, R, T, E, F);
 
         emit sendMessage("RMS reprojection error of " + QString::number(rms) + " for stereo camera");
     }
@@ -221,29 +278,24 @@ void CalibrationThread::rectifyImage()
     {
 
         // Calculate transforms for rectifying images
-        cv::Mat Rl, Rr, Pl, Pr;
-        cv::Size imageSize = imagesLeft[0].size();
+        calibration.imageSize = imageSize;
+        calibration.cameraMatrixLeft = cameraMatrixLeft;
+        calibration.cameraMatrixRight = cameraMatrixRight;
+        calibration.distCoeffsLeft = distCoeffsLeft;
+        calibration.distCoeffsRight = distCoeffsRight;
+        calibration.R = R;
+        calibration.T = T;
+        calibration.E = E;
+        calibration.F = F;
         cv::stereoRectify(cameraMatrixLeft, distCoeffsLeft, cameraMatrixRight,
-                          distCoeffsRight, imageSize, R, T, Rl, Rr, Pl, Pr, Q);
+                          distCoeffsRight, calibration.imageSize, R, T,
+                          calibration.Rl, calibration.Rr, calibration.Pl, calibration.Pr, calibration.Q);
 
         // Calculate pixel maps for efficient rectification of images via lookup tables
-        cv::initUndistortRectifyMap(cameraMatrixLeft, distCoeffsLeft, Rl, Pl, imageSize,
-                                    CV_16SC2, map_l1, map_l2);
-        cv::initUndistortRectifyMap(cameraMatrixRight, distCoeffsRight, Rr, Pr, imageSize,
-                                    CV_16SC2, map_r1, map_r2);
-
-        QString fileName = calibDir + "stereo_calib.xml";
-        cv::FileStorage fs(fileName.toStdString(), cv::FileStorage::APPEND);
-        fs << "Rl" << Rl;
-        fs << "Rr" << Rr;
-        fs << "Pl" << Pl;
-        fs << "Pr" << Pr;
-        fs << "Q" << Q;
-        fs << "map_l1" << map_l1;
-        fs << "map_l2" << map_l2;
-        fs << "map_r1" << map_r1;
-        fs << "map_r2" << map_r2;
-        fs.release();
+        calibration.initRectificationMaps();
+
+        // Only the parameters go to the XML file, the maps are cached in binary form next to it
+        calibration.save(calibDir + "stereo_calib.xml");
 
         emit sendMessage("Finished stereo rectification");
     }
@@ -2,12 +2,11 @@
 #define CALIBRATIONTHREAD_H
 
 //Qt
-#include <QThread>
 #include <QDir>
 #include <QDirIterator>
 #include <QVector>
 #include <QList>
-#include <QMutex>
+#include <QStringList>
 
 //OpenCV
 #include <opencv2/opencv.hpp>
@@ -16,46 +15,57 @@
 
 //Local
 #include "utilities.h"
+#include "stereocalibration.h"
+#include "scheduledtask.h"
 
 #include <vector>
 
-class CalibrationThread : public QThread
+/* Calibrates both cameras, the stereo pair and its rectification as a background task.
+ * The two single camera calibrations are independent and run as parallel tasks. */
+class CalibrationThread : public ScheduledTask
 {
     Q_OBJECT
 public:
 
     CalibrationThread(QString calibDir, cv::Size patternSize, float sideLength);
-    void stop();
 
 private:
 
-    int progressCounter;
+    class CameraCalibration;
 
-    volatile bool doStop;
-    QMutex doStopMutex;
-    QMutex processingMutex;
+    int progressCounter;
 
     QString calibDir;
 
-    QList<cv::Mat> imagesLeft; // Chessboard images
-    QList<cv::Mat> imagesRight;
+    QStringList filesLeft; // Chessboard images, decoded one at a time while detecting their corners
+    QStringList filesRight;
+    cv::Size imageSize;
+
+    // Corners of every calibration image, detected once and shared by mono and stereo calibration.
+    // Only these and the image size are kept, not the images themselves.
+    std::vector<std::vector<cv::Point2f> > cornersLeft, cornersRight;
+    std::vector<uchar> foundLeft, foundRight;
     cv::Mat cameraMatrixLeft, cameraMatrixRight;
     cv::Mat distCoeffsLeft, distCoeffsRight;
 
     float sideLength; //side length of a chessboard square in mm
     cv::Size patternSize; //number of internal corners of the chessboard along width and height
-    std::vector<std::vector<cv::Point2f> > imagePointsLeft, imagePointsRight; // 2D image points
-    std::vector<std::vector<cv::Point3f> > objectPoints; // 3D object points
+    std::vector<std::vector<cv::Point2f> > imagePointsLeft, imagePointsRight; // 2D image points of the stereo pairs
+    std::vector<std::vector<cv::Point3f> > objectPoints; // 3D object points of the stereo pairs
 
     cv::Mat R, T, E, F; //stereo calibration information
-    cv::Mat map_l1, map_l2, map_r1, map_r2; //pixel maps for rectification
-    cv::Mat Q;
-
-    void loadImages(QString camera, QList<cv::Mat> &images);
-    void calcImagePoints(std::vector<std::vector<cv::Point2f> > &imagePoints, QList<cv::Mat> &images);
+    StereoCalibration calibration; //stereo rectification data written to stereo_calib.xml
+
+    void listImages(QString camera, QStringList &files);
+    void detectCorners();
+    std::vector<cv::Point3f> boardPoints() const;
+    void calcImagePoints(std::vector<std::vector<cv::Point3f> > &objectPoints,
+                         std::vector<std::vector<cv::Point2f> > &imagePoints,
+                         const std::vector<std::vector<cv::Point2f> > &corners, const std::vector<uchar> &found) const;
     void calcImagePointsStereo();
     void singleCameraCalibration(QString camera, cv::Mat &cameraMatrix, cv::Mat &distCoeffs,
-                                 std::vector<std::vector<cv::Point2f> > imagePoints, QList<cv::Mat> images);
+                                 const std::vector<std::vector<cv::Point3f> > &objectPoints,
+                                 const std::vector<std::vector<cv::Point2f> > &imagePoints);
     void stereoCalibration();
     void rectifyImage();
 
@@ -67,8 +77,7 @@ signals:
 
     void updateProgress(int);
     void sendMessage(const QString &rmsError);
-    void sendRectificationData(const cv::Mat &map_l1, const cv::Mat &map_l2, const cv::Mat &map_r1,
-                               const cv::Mat &map_r2, const cv::Mat &Q);
+    void sendRectificationData(const StereoCalibration &calibration);
 
 
 };
@@ -0,0 +1,95 @@
+#include "capturethread.h"
+#include "utilities.h"
+
+CaptureThread::CaptureThread(int deviceNumber, FramePool *pool, FrameRing *ring)
+{
+    this->deviceNumber = deviceNumber;
+    this->pool = pool;
+    this->ring = ring;
+
+    droppedFrames = 0;
+
+    doStop = false;
+}
+
+CaptureThread::~CaptureThread()
+{
+    stop();
+    wait();
+    capture.release();
+}
+
+void CaptureThread::stop()
+{
+    QMutexLocker locker(&doStopMutex);
+    doStop = true;
+}
+
+int CaptureThread::getDeviceNumber() const
+{
+    return deviceNumber;
+}
+
+void CaptureThread::run()
+{
+    doStopMutex.lock();
+    doStop = false;
+    doStopMutex.unlock();
+
+    if(!capture.isOpened())
+    {
+        capture.open(deviceNumber);
+    }
+    if(!capture.isOpened())
+    {
+        emit sendMessage("Could not open camera " + QString::number(deviceNumber), 2500);
+        return;
+    }
+
+    int width = (int)capture.get(CV_CAP_PROP_FRAME_WIDTH);
+    int height = (int)capture.get(CV_CAP_PROP_FRAME_HEIGHT);
+    if(width > 0 && height > 0)
+    {
+        pool->preallocate(cv::Size(width, height), CV_8UC3);
+    }
+
+    while(true)
+    {
+        doStopMutex.lock();
+        if(doStop)
+        {
+            doStop = false;
+            doStopMutex.unlock();
+            break;
+        }
+        doStopMutex.unlock();
+
+        if(!capture.grab())
+        {
+            msleep(1);
+            continue;
+        }
+
+        //grab() returns once the frame is latched, which is the closest we get to the exposure time
+        double timestamp = captureTimestamp();
+
+        FrameLease frame = pool->acquire();
+        if(frame.isNull())
+        {
+            //Consumers still hold every buffer, skip this frame rather than allocating a new one
+            if(++droppedFrames % 100 == 1)
+            {
+                emit sendMessage("Frame pool of camera " + QString::number(deviceNumber) + " exhausted, dropping frames", 2500);
+            }
+            continue;
+        }
+
+        // retrieve() points its argument at the single internal frame of the backend, which the next
+        // grab() overwrites, so the pixels are copied into the pooled buffer
+        if(capture.retrieve(retrieved))
+        {
+            pool->write(frame, retrieved);
+            ring->push(frame, timestamp);
+        }
+    }
+}
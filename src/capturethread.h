@@ -0,0 +1,50 @@
+#ifndef CAPTURETHREAD_H
+#define CAPTURETHREAD_H
+
+//Qt
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+//Local
+#include "framering.h"
+#include "framepool.h"
+
+class CaptureThread : public QThread
+{
+    Q_OBJECT
+public:
+
+    CaptureThread(int deviceNumber, FramePool *pool, FrameRing *ring);
+    ~CaptureThread();
+    void stop();
+
+    int getDeviceNumber() const;
+
+private:
+
+    volatile bool doStop;
+    QMutex doStopMutex;
+
+    int deviceNumber;
+    cv::VideoCapture capture;
+    FramePool *pool; //retrieved frames are copied into free pool buffers
+    cv::Mat retrieved; //header on the backend's frame, only valid until the next grab()
+    FrameRing *ring;
+    int droppedFrames; //frames skipped because every pool buffer was leased
+
+protected:
+
+    void run(); //grab frames until stopped
+
+signals:
+
+    void sendMessage(const QString &message, int timeout);
+
+};
+
+#endif // CAPTURETHREAD_H
@@ -2,15 +2,87 @@
 
 #include <QDebug>
 
-CategorizerThread::CategorizerThread(cv::Mat frame, QMap<QString, cv::SVM> svms,
+#include <algorithm>
+#include <limits>
+
+// Weight of the latest verification outcome in the prior of a category
+static const double priorAlpha = 0.3;
+
+struct CategorizerThread::Recognition
+{
+    qint64 ticket;
+    StereoFramePtr frame;
+    cv::Ptr<cv::BOWImgDescriptorExtractor> bowDescriptorExtractor; //reserved for this frame pair
+    int extractor;
+    double deadline; //captureTimestamp() by which the result is due
+
+    std::vector<cv::KeyPoint> keypoints;
+    cv::Mat descriptors;
+    std::vector<QString> predictedCategories; //most likely first
+    QAtomicInt nextCategory; //claimed by the verifications in order, whichever of them runs first
+
+    QMutex detectedObjectsMutex; //written by the parallel verifications
+    QMap<QString, std::vector<cv::Point2f> > detectedObjects;
+    QStringList deferredCategories; //not verified within the budget
+};
+
+/* Verification order: deferred categories first, then by detection history and SVM margin. */
+struct CategoryCandidate
+{
+    QString category;
+    bool carried;
+    double prior;
+    float margin; //SVM decision value, more negative is more confident
+
+    bool operator<(const CategoryCandidate &other) const
+    {
+        if(carried != other.carried)
+        {
+            return carried;
+        }
+        if(prior != other.prior)
+        {
+            return prior > other.prior;
+        }
+        return margin < other.margin;
+    }
+};
+
+/* One stage of the pipeline for one frame pair, index selects the category of a verification. */
+class CategorizerThread::Stage : public Task
+{
+public:
+
+    typedef void (CategorizerThread::*Function)(const RecognitionPtr &recognition, int index);
+
+    Stage(CategorizerThread *categorizer, Function function, const RecognitionPtr &recognition, int index = 0) :
+        Task(Task::Interactive), categorizer(categorizer), function(function), recognition(recognition), index(index)
+    {
+    }
+
+protected:
+
+    void run()
+    {
+        (categorizer->*function)(recognition, index);
+    }
+
+private:
+
+    CategorizerThread *categorizer;
+    Function function;
+    RecognitionPtr recognition;
+    int index;
+};
+
+CategorizerThread::CategorizerThread(QMap<QString, cv::SVM> svms,
                                      cv::Mat vocab,
                                      QMap<QString, std::vector<cv::KeyPoint> > keypoints,
                                      QMap<QString, cv::Mat> desc,
                                      QMap<QString, cv::Mat> templates,
-                                     QList<QString> categoryNames) :
-    QThread()
+                                     QList<QString> categoryNames,
+                                     int maxFramesInFlight)
 {
-    this->frame = frame;
     this->desc = desc;
     this->svms = svms;
     this->vocab = vocab;
@@ -20,98 +92,278 @@ CategorizerThread::CategorizerThread(cv::Mat frame, QMap<QString, cv::SVM> svms,
 
     categories = this->categoryNames.size();
 
-    featureDetector = new cv::SurfFeatureDetector(500);
     descriptorExtractor = new cv::SurfDescriptorExtractor();
     descriptorMatcher = new cv::FlannBasedMatcher();
-    bowDescriptorExtractor = new cv::BOWImgDescriptorExtractor(descriptorExtractor, descriptorMatcher);
-    bowDescriptorExtractor->setVocabulary(this->vocab);
 
-    doStop = false;
+    this->maxFramesInFlight = std::max(1, maxFramesInFlight);
+    framesInFlight = 0;
+    stopped = false;
+    nextTicket = 0;
+    nextDelivery = 0;
+    latencyBudget = 66.0;
+}
+
+CategorizerThread::~CategorizerThread()
+{
+    stop();
+    wait();
 }
 
-void CategorizerThread::run()
+bool CategorizerThread::submit(const StereoFramePtr &frame)
 {
-    doStopMutex.lock();
-    if(doStop)
+    RecognitionPtr recognition(new Recognition());
     {
-        doStop = false;
-        doStopMutex.unlock();
+        QMutexLocker locker(&pipelineMutex);
+        if(stopped || framesInFlight >= maxFramesInFlight)
+        {
+            return false;
+        }
+
+        // Reserve a BOW extractor, one is created for every frame pair that can be in flight
+        int extractor = 0;
+        while(extractor < (int)extractorInUse.size() && extractorInUse[extractor])
+        {
+            extractor++;
+        }
+        if(extractor == (int)bowDescriptorExtractors.size())
+        {
+            cv::Ptr<cv::BOWImgDescriptorExtractor> bowDescriptorExtractor =
+                    new cv::BOWImgDescriptorExtractor(descriptorExtractor, new cv::FlannBasedMatcher());
+            bowDescriptorExtractor->setVocabulary(vocab);
+            bowDescriptorExtractors.push_back(bowDescriptorExtractor);
+            extractorInUse.push_back(false);
+        }
+        extractorInUse[extractor] = true;
+
+        recognition->ticket = nextTicket++;
+        recognition->frame = frame;
+        recognition->bowDescriptorExtractor = bowDescriptorExtractors[extractor];
+        recognition->extractor = extractor;
+        framesInFlight++;
+
+        // The budget counts from capture, frames without a capture time start it now
+        double start = frame->getTimestamp() > 0.0 ? frame->getTimestamp() : captureTimestamp();
+        recognition->deadline = latencyBudget > 0.0 ? start + latencyBudget : std::numeric_limits<double>::max();
     }
-    doStopMutex.unlock();
 
-    processingMutex.lock();
+    TaskScheduler::instance()->submit(TaskPtr(new Stage(this, &CategorizerThread::extract, recognition)));
+    return true;
+}
 
-    std::vector<cv::KeyPoint> kp_frame;
-    cv::Mat bowDescriptor;
-    cv::Mat frame_g;
-    cv::Mat desc_frame;
-    std::vector<QString> predictedCategories;
+bool CategorizerThread::isBusy() const
+{
+    QMutexLocker locker(&pipelineMutex);
+    return framesInFlight >= maxFramesInFlight;
+}
 
-    cv::cvtColor(frame, frame_g, CV_BGR2GRAY);
+int CategorizerThread::getFramesInFlight() const
+{
+    QMutexLocker locker(&pipelineMutex);
+    return framesInFlight;
+}
 
-    //Extract frame BOW descriptor and SURF descriptor
-    featureDetector -> detect(frame_g, kp_frame);
-    descriptorExtractor ->compute(frame_g, kp_frame, desc_frame);
-    bowDescriptorExtractor -> compute(frame_g, kp_frame, bowDescriptor);
+void CategorizerThread::stop()
+{
+    QMutexLocker locker(&pipelineMutex);
+    stopped = true;
+}
 
-    // Predict using SVMs for all categories, choose the prediction with the most negative signed distance measure
-    if(predictedCategories.size() > 0) {
-        predictedCategories.clear();
+void CategorizerThread::wait()
+{
+    QMutexLocker locker(&pipelineMutex);
+    while(framesInFlight > 0)
+    {
+        idleCondition.wait(&pipelineMutex);
     }
+}
+
+int CategorizerThread::getMaxFramesInFlight() const
+{
+    QMutexLocker locker(&pipelineMutex);
+    return maxFramesInFlight;
+}
+
+void CategorizerThread::setMaxFramesInFlight(int value)
+{
+    QMutexLocker locker(&pipelineMutex);
+    maxFramesInFlight = std::max(1, value);
+}
+
+double CategorizerThread::getLatencyBudget() const
+{
+    QMutexLocker locker(&pipelineMutex);
+    return latencyBudget;
+}
+
+void CategorizerThread::setLatencyBudget(double value)
+{
+    QMutexLocker locker(&pipelineMutex);
+    latencyBudget = std::max(0.0, value);
+}
+
+bool CategorizerThread::getAdaptiveKeypoints() const
+{
+    return keypointDetector.isAdaptive();
+}
+
+void CategorizerThread::setAdaptiveKeypoints(bool value)
+{
+    keypointDetector.setAdaptive(value);
+}
+
+int CategorizerThread::getKeypointTarget() const
+{
+    return keypointDetector.getTargetKeypoints();
+}
+
+void CategorizerThread::setKeypointTarget(int value)
+{
+    keypointDetector.setTargetKeypoints(value);
+}
+
+void CategorizerThread::extract(const RecognitionPtr &recognition, int)
+{
+    try
+    {
+        const cv::Mat &frame_g = recognition->frame->grayLeft(); //shared with the other consumers of the frame pair
+        cv::Mat bowDescriptor;
 
-    for(int i = 0; i < categories; i++) {
-        QString category = categoryNames[i];
+        //Extract frame BOW descriptor and SURF descriptor
+        keypointDetector.detect(frame_g, recognition->keypoints); //stable describe, BOW and match cost per frame
+        recognition->frame->setKeypointsLeft(recognition->keypoints); //reused by the sparse distance engine
+        descriptorExtractor -> compute(frame_g, recognition->keypoints, recognition->descriptors);
+        recognition->bowDescriptorExtractor -> compute(frame_g, recognition->keypoints, bowDescriptor);
 
-        //cv::redirectError(handleError);
-        if(svms.contains(category))
+        QStringList carried;
+        QMap<QString, double> priors;
+        pipelineMutex.lock();
+        carried = carriedCategories;
+        carriedCategories.clear();
+        priors = categoryPriors;
+        pipelineMutex.unlock();
+
+        // Predict using SVMs for all categories, a negative signed distance measure predicts the category
+        std::vector<CategoryCandidate> candidates;
+        for(int i = 0; i < categories; i++)
         {
-            try
+            QString category = categoryNames[i];
+
+            // Read-only lookup, other frame pairs are classified at the same time
+            QMap<QString, cv::SVM>::const_iterator svm = svms.constFind(category);
+            if(svm != svms.constEnd())
             {
-                float prediction = svms[category].predict(bowDescriptor, true);
-                if(prediction < 0.5)
+                float prediction = svm.value().predict(bowDescriptor, true);
+                if(prediction < 0.5 || carried.contains(category))
                 {
-                   predictedCategories.push_back(category);
+                    CategoryCandidate candidate;
+                    candidate.category = category;
+                    candidate.carried = carried.contains(category);
+                    candidate.prior = priors.value(category, 0.0);
+                    candidate.margin = prediction;
+                    candidates.push_back(candidate);
                 }
             }
-            catch(cv::Exception e)
-            {
-                emit sendException(QString::fromStdString(e.err), 2500);
-            }
         }
-    }
 
-    std::vector<QString>::iterator iter;
-    if(predictedCategories.size() > 0)
-    {
-        for(iter = predictedCategories.begin(); iter != predictedCategories.end(); iter++)
+        std::sort(candidates.begin(), candidates.end());
+        for(size_t i = 0; i < candidates.size(); i++)
         {
-            objectRecognition(kp_frame, desc_frame, *iter);
+            recognition->predictedCategories.push_back(candidates[i].category);
         }
     }
+    catch(const cv::Exception &e)
+    {
+        recognition->predictedCategories.clear();
+        emit sendException(QString::fromStdString(e.err), 2500);
+    }
+    catch(...)
+    {
+        // The frame pair still has to complete, or every later one would wait for it in the reorder buffer
+        recognition->predictedCategories.clear();
+        emit sendException("Frame pair could not be categorized", 2500);
+    }
 
-    processingMutex.unlock();
-
-    // Inform GUI thread of detected objects
-    emit doneProcessing(detectedObjects);
-
-}
-void CategorizerThread::stop()
-{
-    QMutexLocker locker(&doStopMutex);
-    doStop = true;
+    // The predicted categories are verified in parallel, the frame pair completes once all of them are done
+    QList<TaskPtr> verifications;
+    for(size_t i = 0; i < recognition->predictedCategories.size(); i++)
+    {
+        verifications.append(TaskPtr(new Stage(this, &CategorizerThread::verify, recognition, i)));
+    }
+    for(int i = 0; i < verifications.size(); i++)
+    {
+        TaskScheduler::instance()->submit(verifications[i]);
+    }
+    TaskScheduler::instance()->submit(TaskPtr(new Stage(this, &CategorizerThread::complete, recognition)),
+                                      verifications);
 }
-cv::Mat CategorizerThread::getFrame() const
+
+void CategorizerThread::verify(const RecognitionPtr &recognition, int)
 {
-    return frame;
+    // Each verification takes the most likely category left, so the order holds however the tasks are scheduled
+    int index = recognition->nextCategory.fetchAndAddOrdered(1);
+    if(index >= (int)recognition->predictedCategories.size())
+    {
+        return;
+    }
+    const QString &category = recognition->predictedCategories[index];
+
+    // The most likely category is always verified, so every frame pair makes progress
+    if(index > 0 && captureTimestamp() > recognition->deadline)
+    {
+        QMutexLocker locker(&recognition->detectedObjectsMutex);
+        recognition->deferredCategories.append(category);
+        return;
+    }
+
+    objectRecognition(recognition->keypoints, recognition->descriptors, category,
+                      recognition->detectedObjects, recognition->detectedObjectsMutex);
 }
 
-void CategorizerThread::setFrame(const cv::Mat &value)
+void CategorizerThread::complete(const RecognitionPtr &recognition, int)
 {
-    frame = value;
-}
+    QMutexLocker locker(&pipelineMutex);
+    extractorInUse[recognition->extractor] = false;
+
+    // Emitted under the lock, so the queued signals reach the GUI thread in frame order
+    reorderBuffer.insert(recognition->ticket, recognition);
+    while(reorderBuffer.contains(nextDelivery))
+    {
+        RecognitionPtr ready = reorderBuffer.take(nextDelivery++);
 
+        for(size_t i = 0; i < ready->predictedCategories.size(); i++)
+        {
+            const QString &category = ready->predictedCategories[i];
+            if(ready->deferredCategories.contains(category))
+            {
+                // Verified first on the next frame pair, shown where it was last found meanwhile
+                if(!carriedCategories.contains(category))
+                {
+                    carriedCategories.append(category);
+                }
+                if(lastDetections.contains(category))
+                {
+                    ready->detectedObjects[category] = lastDetections[category];
+                }
+            }
+            else
+            {
+                double found = ready->detectedObjects.contains(category) ? 1.0 : 0.0;
+                categoryPriors[category] = (1.0 - priorAlpha) * categoryPriors.value(category, 0.0) + priorAlpha * found;
+            }
+        }
+        lastDetections = ready->detectedObjects;
+
+        emit doneProcessing(ready->detectedObjects, ready->frame);
+        framesInFlight--;
+    }
+
+    idleCondition.wakeAll();
+}
 
-void CategorizerThread::objectRecognition(std::vector<cv::KeyPoint> kpFrame, cv::Mat descFrame, QString category)
+void CategorizerThread::objectRecognition(const std::vector<cv::KeyPoint> &kpFrame, const cv::Mat &descFrame,
+                                          const QString &category,
+                                          QMap<QString, std::vector<cv::Point2f> > &detectedObjects,
+                                          QMutex &detectedObjectsMutex)
 {
    std::vector<std::vector<cv::DMatch> > matches;
    std::vector<cv::Point2f> obj;
@@ -121,13 +373,15 @@ void CategorizerThread::objectRecognition(std::vector<cv::KeyPoint> kpFrame, cv:
    cv::Mat H;
    int goodMatchesCounter;
 
-   std::vector<cv::KeyPoint> kpTemplate = keypoints[category];
-   cv::Mat descTemplate = desc[category];
+   // Read-only lookups, several categories are verified at the same time
+   std::vector<cv::KeyPoint> kpTemplate = keypoints.value(category);
+   cv::Mat descTemplate = desc.value(category);
+   cv::Mat objectTemplate = templates.value(category);
 
    obj_corners[0] = cv::Point(0, 0);
-   obj_corners[1] = cv::Point(templates[category].cols, 0);
-   obj_corners[2] = cv::Point(templates[category].cols, templates[category].rows);
-   obj_corners[3] = cv::Point(0, templates[category].rows);
+   obj_corners[1] = cv::Point(objectTemplate.cols, 0);
+   obj_corners[2] = cv::Point(objectTemplate.cols, objectTemplate.rows);
+   obj_corners[3] = cv::Point(0, objectTemplate.rows);
 
    try
    {
@@ -153,6 +407,7 @@ void CategorizerThread::objectRecognition(std::vector<cv::KeyPoint> kpFrame, cv:
    {
        H = cv::findHomography(obj, scene, CV_RANSAC);
        cv::perspectiveTransform(obj_corners, scene_corners, H);
+       QMutexLocker locker(&detectedObjectsMutex);
        detectedObjects[category] = scene_corners;
 
    }
@@ -2,10 +2,14 @@
 #define CATEGORIZERTHREAD_H
 
 //Qt
-#include <QThread>
+#include <QObject>
 #include <vector>
 #include <QMap>
 #include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QSharedPointer>
+#include <QStringList>
 
 //OpenCV
 #include <opencv2/opencv.hpp>
@@ -14,52 +18,97 @@
 #include <opencv2/nonfree/features2d.hpp>
 #include <opencv2/ml/ml.hpp>
 
-class CategorizerThread : public QThread
+//Local
+#include "stereoframe.h"
+#include "taskscheduler.h"
+#include "utilities.h"
+#include "adaptivesurfdetector.h"
+
+/* Object categorization pipeline on the shared task scheduler.
+ * Every submitted frame pair goes through three stages run as tasks: feature extraction and SVM classification,
+ * the homography verification of every predicted category in parallel, and completion. Up to maxFramesInFlight
+ * frame pairs are processed at the same time, so frame N+1 is being described while frame N is verified.
+ * Results finishing out of order wait in a reorder buffer, doneProcessing() is emitted in submission order.
+ * Predicted categories are verified in order of their prior likelihood (categories deferred by the previous
+ * frame pair, then the detection history, then the SVM margin). Once the per-frame latency budget is used up
+ * the remaining categories are deferred to the next frame pair and keep their last known position. */
+class CategorizerThread : public QObject
 {
     Q_OBJECT
 public:
 
-    CategorizerThread(cv::Mat frame, QMap<QString, cv::SVM> svms, cv::Mat vocab,
+    CategorizerThread(QMap<QString, cv::SVM> svms, cv::Mat vocab,
                       QMap<QString, std::vector<cv::KeyPoint> > keypoints, QMap<QString, cv::Mat> desc,
-                      QMap<QString, cv::Mat> templates, QList<QString> categoryNames);
-    void stop();
+                      QMap<QString, cv::Mat> templates, QList<QString> categoryNames, int maxFramesInFlight = 1);
+    ~CategorizerThread();
 
-    cv::Mat getFrame() const;
-    void setFrame(const cv::Mat &value);
+    bool submit(const StereoFramePtr &frame); //false while maxFramesInFlight pairs are being processed or stopped
+    bool isBusy() const;
+    int getFramesInFlight() const;
+
+    void stop(); //refuse new frame pairs, those in flight are completed
+    void wait(); //until no frame pair is in flight
+
+    int getMaxFramesInFlight() const;
+    void setMaxFramesInFlight(int value);
+
+    double getLatencyBudget() const;
+    void setLatencyBudget(double value); //ms from capture to result, 0 verifies every category
+
+    bool getAdaptiveKeypoints() const;
+    void setAdaptiveKeypoints(bool value); //hold getKeypointTarget() keypoints per frame instead of a fixed threshold
+
+    int getKeypointTarget() const;
+    void setKeypointTarget(int value);
 
 private:
 
-    volatile bool doStop;
-    QMutex doStopMutex;
-    QMutex processingMutex;
+    struct Recognition; //state of one frame pair moving through the stages
+    typedef QSharedPointer<Recognition> RecognitionPtr;
+    class Stage;
 
-    cv::Mat frame;
     QMap<QString, cv::Mat> templates;
     QMap<QString, cv::SVM> svms; //trained SVMs, mapped by category name
     int categories; //number of categories
     cv::Mat vocab; //vocabulary
     QMap<QString, std::vector<cv::KeyPoint> > keypoints; //map of template keypoints
     QMap<QString, cv::Mat> desc; //map of template descriptors
-    QMap<QString, std::vector<cv::Point2f> > detectedObjects;
     QList<QString> categoryNames;
 
 
-    // Feature detectors and descriptor extractors
-    cv::Ptr<cv::FeatureDetector> featureDetector;
+    // Feature detectors and descriptor extractors, the BOW extractor trains its matcher on use and
+    // is kept once per frame pair in flight
+    AdaptiveSurfDetector keypointDetector;
     cv::Ptr<cv::DescriptorExtractor> descriptorExtractor;
-    cv::Ptr<cv::BOWImgDescriptorExtractor> bowDescriptorExtractor;
     cv::Ptr<cv::FlannBasedMatcher> descriptorMatcher;
-
-    void objectRecognition(std::vector<cv::KeyPoint> kpFrame, cv::Mat descFrame, QString category); //recognize object
-
-protected:
-
-    void run(); //function to perform real-time object categorization on camera frames
+    std::vector<cv::Ptr<cv::BOWImgDescriptorExtractor> > bowDescriptorExtractors;
+    std::vector<bool> extractorInUse;
+
+    mutable QMutex pipelineMutex;
+    QWaitCondition idleCondition;
+    int maxFramesInFlight;
+    int framesInFlight;
+    bool stopped;
+    qint64 nextTicket; //submission order of the next frame pair
+    qint64 nextDelivery; //ticket whose result is emitted next
+    QMap<qint64, RecognitionPtr> reorderBuffer; //completed frame pairs waiting for earlier ones
+
+    double latencyBudget;
+    QMap<QString, double> categoryPriors; //moving average of the verification outcome per category
+    QStringList carriedCategories; //deferred by a delivered frame pair, verified first on the next one
+    QMap<QString, std::vector<cv::Point2f> > lastDetections; //last delivered result
+
+    void extract(const RecognitionPtr &recognition, int index);
+    void verify(const RecognitionPtr &recognition, int index);
+    void complete(const RecognitionPtr &recognition, int index);
+
+    void objectRecognition(const std::vector<cv::KeyPoint> &kpFrame, const cv::Mat &descFrame, const QString &category,
+                           QMap<QString, std::vector<cv::Point2f> > &detectedObjects, QMutex &detectedObjectsMutex);
 
 signals:
 
     void sendException(const QString &err, int timeout);
-    void doneProcessing(const QMap<QString, std::vector<cv::Point2f> > &detectedObjects);
+    void doneProcessing(const QMap<QString, std::vector<cv::Point2f> > &detectedObjects, const StereoFramePtr &frame);
 
 };
 
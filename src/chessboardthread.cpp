@@ -0,0 +1,56 @@
+#include "chessboardthread.h"
+
+ChessboardThread::ChessboardThread()
+{
+}
+
+void ChessboardThread::submit(const cv::Mat &grayLeft, const cv::Mat &grayRight, cv::Size patternSize)
+{
+    QMutexLocker locker(&inputMutex);
+    pendingLeft = grayLeft;
+    pendingRight = grayRight;
+    pendingPatternSize = patternSize;
+    schedule();
+}
+
+bool ChessboardThread::hasPending() const
+{
+    return !pendingLeft.empty();
+}
+
+void ChessboardThread::takePending()
+{
+    grayLeft = pendingLeft;
+    grayRight = pendingRight;
+    patternSize = pendingPatternSize;
+    clearPending();
+}
+
+void ChessboardThread::clearPending()
+{
+    pendingLeft.release();
+    pendingRight.release();
+}
+
+void ChessboardThread::process()
+{
+    std::vector<cv::Point2f> cornersLeft, cornersRight;
+    bool foundLeft = false, foundRight = false;
+    try
+    {
+        foundLeft = findChessboard(grayLeft, patternSize, cornersLeft, cv::Size(11, 11));
+        foundRight = findChessboard(grayRight, patternSize, cornersRight, cv::Size(11, 11));
+    }
+    catch(const cv::Exception& e)
+    {
+        // Reported as no pattern found, the worker keeps running for the next pair
+        qWarning("%s", e.err.c_str());
+        foundLeft = foundRight = false;
+    }
+
+    grayLeft.release();
+    grayRight.release();
+
+    //Inform GUI of the corners, they are drawn on the following live frames
+    emit chessboardCorners(cornersLeft, foundLeft, cornersRight, foundRight, patternSize);
+}
@@ -0,0 +1,46 @@
+#ifndef CHESSBOARDTHREAD_H
+#define CHESSBOARDTHREAD_H
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+
+//Local
+#include "utilities.h"
+#include "streamingtask.h"
+
+#include <vector>
+
+/* Persistent worker detecting the chessboard in live grayscale frame pairs for the calibration preview.
+ * Only the latest submitted pair is processed, pairs arriving while a detection runs replace each other. */
+class ChessboardThread : public StreamingTask
+{
+    Q_OBJECT
+public:
+
+    ChessboardThread();
+
+    void submit(const cv::Mat &grayLeft, const cv::Mat &grayRight, cv::Size patternSize);
+
+private:
+
+    cv::Mat pendingLeft, pendingRight; //latest submitted pair, empty once taken
+    cv::Size pendingPatternSize;
+
+    cv::Mat grayLeft, grayRight; //pair being processed
+    cv::Size patternSize;
+
+protected:
+
+    bool hasPending() const;
+    void takePending();
+    void clearPending();
+    void process();
+
+signals:
+
+    void chessboardCorners(const std::vector<cv::Point2f> &cornersLeft, bool foundLeft,
+                           const std::vector<cv::Point2f> &cornersRight, bool foundRight, const cv::Size &patternSize);
+
+};
+
+#endif // CHESSBOARDTHREAD_H
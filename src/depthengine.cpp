@@ -0,0 +1,442 @@
+#include "depthengine.h"
+#include "utilities.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Priors older than this many frame pairs are ignored
+static const int maxPriorAge = 5;
+
+// Measurements with fewer valid pixels (or matched keypoints) than this do not seed a prior
+static const float minPriorConfidence = 0.25f;
+
+// Half width of the narrowed search window, relative to the disparity, and its lower bound in pixels
+static const float priorMarginFraction = 0.25f;
+static const int minPriorMargin = 8;
+
+// Automatic matcher policy: block matching is kept while this fraction of the object pixels gets a
+// disparity, and the matcher not in use is measured again after this many requests
+static const double minBlockValidFraction = 0.5;
+static const int reprobeInterval = 20;
+
+DepthEngine::DepthEngine()
+{
+    stereo.preFilterCap = 63;
+    stereo.SADWindowSize = 3;
+
+    int cn = 1; //all matchers work on rectified grayscale
+
+    stereo.P1 = 8*cn*stereo.SADWindowSize*stereo.SADWindowSize;
+    stereo.P2 = 32*cn*stereo.SADWindowSize*stereo.SADWindowSize;
+    stereo.minDisparity = 16;
+    stereo.numberOfDisparities = 96;
+    stereo.uniquenessRatio = 10;
+    stereo.speckleWindowSize = 100;
+    stereo.speckleRange = 32;
+    stereo.disp12MaxDiff = 1;
+    stereo.fullDP = false;
+
+    mode = RoiBand;
+    matcher = SemiGlobal;
+    temporalPrior = true;
+    lastLatency = 0.0;
+    lastMatcher = SemiGlobal;
+    latencyBudget = 66.0;
+
+    // Full resolution pairs need a larger window than the obstacle grid to match flat object surfaces
+    initWebcamBlockMatcher(blockStereo, 11);
+    blockStereo.state->speckleWindowSize = 100;
+    blockStereo.state->speckleRange = 32;
+    blockStereo.state->disp12MaxDiff = 1;
+}
+
+DepthEngine::Mode DepthEngine::getMode() const
+{
+    return mode;
+}
+
+void DepthEngine::setMode(Mode value)
+{
+    mode = value;
+}
+
+DepthEngine::Matcher DepthEngine::getMatcher() const
+{
+    return matcher;
+}
+
+void DepthEngine::setMatcher(Matcher value)
+{
+    matcher = value;
+}
+
+bool DepthEngine::getTemporalPrior() const
+{
+    return temporalPrior;
+}
+
+void DepthEngine::setTemporalPrior(bool value)
+{
+    temporalPrior = value;
+    if(!temporalPrior)
+    {
+        priors.clear();
+    }
+}
+
+PyramidStereoMatcher &DepthEngine::getPyramidMatcher()
+{
+    return pyramid;
+}
+
+double DepthEngine::getLastLatency() const
+{
+    return lastLatency;
+}
+
+DepthEngine::Matcher DepthEngine::getLastMatcher() const
+{
+    return lastMatcher;
+}
+
+QString DepthEngine::matcherName(Matcher value)
+{
+    switch(value)
+    {
+    case SemiGlobal: return "semi-global matching";
+    case SparseKeypoints: return "sparse keypoint matching";
+    case CoarseToFine: return "coarse-to-fine matching";
+    case BlockMatching: return "block matching";
+    default: return "automatic matcher choice";
+    }
+}
+
+double DepthEngine::getLatencyBudget() const
+{
+    return latencyBudget;
+}
+
+void DepthEngine::setLatencyBudget(double value)
+{
+    latencyBudget = std::max(value, 1.0);
+}
+
+QMap<QString, DepthStatistics> DepthEngine::computeDistances(const StereoFrame &frame,
+                                                             const QMap<QString, std::vector<cv::Point2f> > &objects)
+{
+    if(frame.left().empty() || frame.right().empty() || !frame.getCalibration().isValid())
+    {
+        return QMap<QString, DepthStatistics>();
+    }
+
+    int64 start = cv::getTickCount();
+    Matcher used = matcher == Automatic ? chooseMatcher() : matcher;
+
+    // Textured objects only need a few matched keypoints each, no disparity map is built
+    QMap<QString, DepthStatistics> distances = used == SparseKeypoints ? computeSparseDistances(frame, objects)
+                                                                       : computeDenseDistances(frame, objects, used);
+
+    lastLatency = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+    lastMatcher = used;
+    updateMatcherStatistics(used, distances);
+    return distances;
+}
+
+DepthEngine::Matcher DepthEngine::chooseMatcher()
+{
+    MatcherStatistics &block = matcherStatistics[BlockMatching];
+    MatcherStatistics &semiGlobal = matcherStatistics[SemiGlobal];
+    block.requestsSinceUse++;
+    semiGlobal.requestsSinceUse++;
+
+    // Unmeasured or long unused matchers are tried again, the cheap one first
+    if(block.samples == 0 || block.requestsSinceUse > reprobeInterval)
+    {
+        return BlockMatching;
+    }
+    if(block.validFraction >= minBlockValidFraction)
+    {
+        return BlockMatching;
+    }
+
+    // Too few valid block matching disparities, SGBM as long as it fits into the budget
+    if(semiGlobal.samples == 0 || semiGlobal.requestsSinceUse > reprobeInterval ||
+       semiGlobal.latency <= latencyBudget || semiGlobal.latency <= block.latency)
+    {
+        return SemiGlobal;
+    }
+    return BlockMatching;
+}
+
+void DepthEngine::updateMatcherStatistics(Matcher used, const QMap<QString, DepthStatistics> &distances)
+{
+    if(distances.isEmpty())
+    {
+        return;
+    }
+
+    double validFraction = 0.0;
+    QMap<QString, DepthStatistics>::const_iterator iter;
+    for(iter = distances.begin(); iter != distances.end(); iter++)
+    {
+        validFraction += iter.value().validFraction;
+    }
+    validFraction /= distances.size();
+
+    // Running averages that follow changes of the scene within a few requests
+    MatcherStatistics &statistics = matcherStatistics[used];
+    double alpha = statistics.samples == 0 ? 1.0 : 0.3;
+    statistics.latency += alpha * (lastLatency - statistics.latency);
+    statistics.validFraction += alpha * (validFraction - statistics.validFraction);
+    statistics.samples++;
+    statistics.requestsSinceUse = 0;
+}
+
+QMap<QString, DepthStatistics> DepthEngine::computeSparseDistances(const StereoFrame &frame,
+                                                                   const QMap<QString, std::vector<cv::Point2f> > &objects)
+{
+    QMap<QString, DepthStatistics> distances;
+
+    QMap<QString, std::vector<cv::Point2f> >::const_iterator iter;
+    for(iter = objects.begin(); iter != objects.end(); iter++)
+    {
+        // Objects are matched independently, each one searches around its own prior
+        SearchWindow window = priorWindow(frame, iter.key());
+        distances[iter.key()] = sparse.objectDepth(frame, iter.value(), window.minDisparity, window.numberOfDisparities);
+        updatePrior(frame, iter.key(), distances[iter.key()], window);
+    }
+    return distances;
+}
+
+QMap<QString, DepthStatistics> DepthEngine::computeDenseDistances(const StereoFrame &frame,
+                                                                  const QMap<QString, std::vector<cv::Point2f> > &objects,
+                                                                  Matcher dense)
+{
+    QMap<QString, DepthStatistics> distances;
+    const StereoCalibration &calibration = frame.getCalibration();
+
+    // Object boxes in rectified co-ordinates, the disparity map is indexed in the rectified image
+    QMap<QString, cv::Rect> rois;
+    cv::Rect covered;
+    SearchWindow window = fullWindow();
+    QMap<QString, std::vector<cv::Point2f> >::const_iterator iter;
+    for(iter = objects.begin(); iter != objects.end(); iter++)
+    {
+        cv::Rect roi = calibration.rectifiedBoundingRect(iter.value());
+        if(roi.area() > 0)
+        {
+            // The shared disparity map has to cover the search window of every object
+            SearchWindow objectWindow = priorWindow(frame, iter.key());
+            window = rois.isEmpty() ? objectWindow : unite(window, objectWindow);
+
+            rois[iter.key()] = roi;
+            covered = covered.area() > 0 ? (covered | roi) : roi;
+        }
+    }
+
+    if(rois.isEmpty())
+    {
+        return distances;
+    }
+
+    // Only the parameters are copied, the matching itself runs on the stripe matchers
+    cv::StereoSGBM params = stereo;
+    params.minDisparity = window.minDisparity;
+    params.numberOfDisparities = window.numberOfDisparities;
+
+    // A single disparity map covering every object is shared by all of them
+    cv::Mat disp;
+    cv::Rect dispRect; //part of the rectified image covered by disp
+    if(dense == CoarseToFine)
+    {
+        computePyramidDisparity(frame, params, covered, disp, dispRect);
+    }
+    else if(dense == BlockMatching)
+    {
+        computeBlockDisparity(frame, params, covered, disp, dispRect);
+    }
+    else if(mode == RoiBand)
+    {
+        computeBandDisparity(frame, params, covered, disp, dispRect);
+    }
+    else
+    {
+        computeFullDisparity(frame, params, disp, dispRect);
+    }
+
+    QMap<QString, cv::Rect>::const_iterator roiIter;
+    for(roiIter = rois.begin(); roiIter != rois.end(); roiIter++)
+    {
+        // Depth straight from Q for the object pixels only, missing disparities are skipped
+        distances[roiIter.key()] = roiDepthStatistics(disp, roiIter.value() - dispRect.tl(),
+                                                      calibration.Q, params.minDisparity);
+        updatePrior(frame, roiIter.key(), distances[roiIter.key()], window);
+    }
+
+    return distances;
+}
+
+DepthEngine::SearchWindow DepthEngine::fullWindow() const
+{
+    SearchWindow window;
+    window.minDisparity = stereo.minDisparity;
+    window.numberOfDisparities = stereo.numberOfDisparities;
+    return window;
+}
+
+DepthEngine::SearchWindow DepthEngine::priorWindow(const StereoFrame &frame, const QString &object) const
+{
+    SearchWindow full = fullWindow();
+
+    // Frames without a sequence number cannot tell how old a prior is
+    if(!temporalPrior || frame.getSequence() < 0 || !priors.contains(object))
+    {
+        return full;
+    }
+
+    const DisparityPrior &prior = priors[object];
+    qint64 age = frame.getSequence() - prior.sequence;
+    if(age < 0 || age > maxPriorAge)
+    {
+        return full;
+    }
+
+    int fullMax = full.minDisparity + full.numberOfDisparities;
+    int margin = std::max(minPriorMargin, (int)std::ceil(prior.disparity * priorMarginFraction));
+
+    SearchWindow window;
+    window.minDisparity = std::max(full.minDisparity, (int)std::floor(prior.disparity) - margin);
+    window.numberOfDisparities = (int)std::ceil(prior.disparity) + margin - window.minDisparity;
+    window.numberOfDisparities = std::max(16, (window.numberOfDisparities + 15) / 16 * 16);
+
+    // Keep the window inside the full range, rounding up to 16 may push it past the end
+    if(window.minDisparity + window.numberOfDisparities > fullMax)
+    {
+        window.minDisparity = std::max(full.minDisparity, fullMax - window.numberOfDisparities);
+        window.numberOfDisparities = std::min(window.numberOfDisparities, full.numberOfDisparities);
+    }
+    return window;
+}
+
+DepthEngine::SearchWindow DepthEngine::unite(const SearchWindow &a, const SearchWindow &b) const
+{
+    SearchWindow window;
+    window.minDisparity = std::min(a.minDisparity, b.minDisparity);
+    int maxDisparity = std::max(a.minDisparity + a.numberOfDisparities, b.minDisparity + b.numberOfDisparities);
+    window.numberOfDisparities = (maxDisparity - window.minDisparity + 15) / 16 * 16;
+    return window;
+}
+
+void DepthEngine::updatePrior(const StereoFrame &frame, const QString &object, const DepthStatistics &depth,
+                              const SearchWindow &window)
+{
+    if(!temporalPrior || frame.getSequence() < 0)
+    {
+        return;
+    }
+
+    // Disparity back from the median depth, d = (q23 / Z - q33) / q32
+    cv::Mat_<double> q;
+    frame.getCalibration().Q.convertTo(q, CV_64F);
+    float disparity = 0.f;
+    if(depth.validCount > 0 && depth.median > 0.f && q(3, 2) != 0.0)
+    {
+        disparity = (float)((q(2, 3) / depth.median - q(3, 3)) / q(3, 2));
+    }
+
+    // A median at the border of a narrowed window means the object may have left it
+    SearchWindow full = fullWindow();
+    bool narrowed = window.minDisparity != full.minDisparity || window.numberOfDisparities != full.numberOfDisparities;
+    bool atBorder = disparity < window.minDisparity + 1 ||
+                    disparity > window.minDisparity + window.numberOfDisparities - 2;
+
+    if(depth.validFraction < minPriorConfidence || disparity <= 0.f || (narrowed && atBorder))
+    {
+        // Fall back to the full range for the next frame pair
+        priors.remove(object);
+        return;
+    }
+
+    DisparityPrior prior;
+    prior.disparity = disparity;
+    prior.sequence = frame.getSequence();
+    priors[object] = prior;
+}
+
+void DepthEngine::computeFullDisparity(const StereoFrame &frame, const cv::StereoSGBM &params, cv::Mat &disp, cv::Rect &dispRect)
+{
+    // Rectification is done once per frame pair and shared with its other consumers
+    const cv::Mat &frameLeftRect = frame.rectifiedGrayLeft();
+    const cv::Mat &frameRightRect = frame.rectifiedGrayRight();
+
+    parallelStereo.compute(params, frameLeftRect, frameRightRect, disp);
+    dispRect = cv::Rect(0, 0, frameLeftRect.cols, frameLeftRect.rows);
+}
+
+cv::Rect DepthEngine::bandRect(const StereoFrame &frame, const cv::StereoSGBM &params, const cv::Rect &roi) const
+{
+    cv::Size imageSize = frame.getCalibration().map_l1.size();
+
+    // SGBM has no valid disparities in its first minDisparity + numberOfDisparities columns, so the band
+    // starts that far left of the object. A few extra rows and columns keep the matching window and the
+    // vertical aggregation paths of the object rows inside the band.
+    int margin = params.SADWindowSize + 8;
+    int searchRange = params.minDisparity + params.numberOfDisparities;
+
+    int x0 = std::max(0, roi.x - searchRange - margin);
+    int x1 = std::min(imageSize.width, roi.x + roi.width + margin);
+    int y0 = std::max(0, roi.y - margin);
+    int y1 = std::min(imageSize.height, roi.y + roi.height + margin);
+    return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+void DepthEngine::computeBandDisparity(const StereoFrame &frame, const cv::StereoSGBM &params, const cv::Rect &roi,
+                                       cv::Mat &disp, cv::Rect &dispRect)
+{
+    const StereoCalibration &calibration = frame.getCalibration();
+    dispRect = bandRect(frame, params, roi);
+
+    // The maps hold source co-ordinates, so a sub-rectangle of them rectifies just that part of the image
+    cv::Mat bandLeft, bandRight;
+    remapToGray(frame.left(), calibration.map_l1(dispRect), calibration.map_l2(dispRect), bandLeft);
+    remapToGray(frame.right(), calibration.map_r1(dispRect), calibration.map_r2(dispRect), bandRight);
+
+    parallelStereo.compute(params, bandLeft, bandRight, disp);
+}
+
+void DepthEngine::computeBlockDisparity(const StereoFrame &frame, const cv::StereoSGBM &params, const cv::Rect &roi,
+                                        cv::Mat &disp, cv::Rect &dispRect)
+{
+    const StereoCalibration &calibration = frame.getCalibration();
+    cv::Size imageSize = calibration.map_l1.size();
+
+    // The band has to hold the larger block matching window
+    cv::StereoSGBM blockParams = params;
+    blockParams.SADWindowSize = blockStereo.state->SADWindowSize;
+    dispRect = mode == RoiBand ? bandRect(frame, blockParams, roi) : cv::Rect(0, 0, imageSize.width, imageSize.height);
+
+    cv::Mat grayLeft, grayRight;
+    remapToGray(frame.left(), calibration.map_l1(dispRect), calibration.map_l2(dispRect), grayLeft);
+    remapToGray(frame.right(), calibration.map_r1(dispRect), calibration.map_r2(dispRect), grayRight);
+
+    // Same search window and fixed-point output as SGBM
+    blockStereo.state->minDisparity = params.minDisparity;
+    blockStereo.state->numberOfDisparities = params.numberOfDisparities;
+    blockStereo(grayLeft, grayRight, disp, CV_16S);
+}
+
+void DepthEngine::computePyramidDisparity(const StereoFrame &frame, const cv::StereoSGBM &params, const cv::Rect &roi,
+                                          cv::Mat &disp, cv::Rect &dispRect)
+{
+    const StereoCalibration &calibration = frame.getCalibration();
+    cv::Size imageSize = calibration.map_l1.size();
+    dispRect = mode == RoiBand ? bandRect(frame, params, roi) : cv::Rect(0, 0, imageSize.width, imageSize.height);
+
+    // Grayscale is enough for both the coarse search and the block matching refinement
+    cv::Mat grayLeft, grayRight;
+    remapToGray(frame.left(), calibration.map_l1(dispRect), calibration.map_l2(dispRect), grayLeft);
+    remapToGray(frame.right(), calibration.map_r1(dispRect), calibration.map_r2(dispRect), grayRight);
+
+    // Only the object pixels are refined, the rest of the map stays invalid
+    pyramid.compute(grayLeft, grayRight, roi - dispRect.tl(), params.minDisparity, params.numberOfDisparities, disp);
+}
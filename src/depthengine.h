@@ -0,0 +1,134 @@
+#ifndef DEPTHENGINE_H
+#define DEPTHENGINE_H
+
+//Qt
+#include <QMap>
+#include <QString>
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+//Local
+#include "stereoframe.h"
+#include "depthstatistics.h"
+#include "sparsestereo.h"
+#include "parallelstereo.h"
+#include "pyramidstereo.h"
+#include "grayremap.h"
+
+#include <vector>
+
+/* Disparity computation shared by the one-shot and the continuous distance workers.
+ * The dense matcher computes one disparity map per call and every requested object is read from it,
+ * the sparse matcher only matches a few keypoints of each object. */
+class DepthEngine
+{
+public:
+
+    enum Mode
+    {
+        FullFrame, //rectify and match the whole image pair
+        RoiBand //rectify and match only the rows covering the objects, widened by the disparity range
+    };
+
+    enum Matcher
+    {
+        SemiGlobal, //dense SGBM disparity over the object rows or the whole frame, see Mode
+        SparseKeypoints, //keypoints inside each object matched along their epipolar line
+        CoarseToFine, //SGBM on a downsampled pair, refined at full resolution around the coarse disparity
+        BlockMatching, //StereoBM, several times faster than SGBM and good enough for textured objects
+        Automatic //BlockMatching or SemiGlobal per request, from their measured latency and valid disparities
+    };
+
+    DepthEngine();
+
+    Mode getMode() const;
+    void setMode(Mode value);
+
+    Matcher getMatcher() const;
+    void setMatcher(Matcher value);
+
+    bool getTemporalPrior() const;
+    void setTemporalPrior(bool value); //narrow the disparity search around the previous frame's disparity
+
+    PyramidStereoMatcher &getPyramidMatcher(); //quality/latency knobs of the CoarseToFine matcher
+
+    QMap<QString, DepthStatistics> computeDistances(const StereoFrame &frame,
+                                                    const QMap<QString, std::vector<cv::Point2f> > &objects);
+
+    double getLastLatency() const; //ms spent in the last computeDistances()
+    Matcher getLastMatcher() const; //matcher used by the last computeDistances(), never Automatic
+
+    static QString matcherName(Matcher value);
+
+    double getLatencyBudget() const;
+    void setLatencyBudget(double value); //ms per request the Automatic policy aims for
+
+private:
+
+    struct DisparityPrior
+    {
+        float disparity; //median disparity of the object in the last frame pair
+        qint64 sequence; //frame pair it was measured in
+    };
+
+    struct MatcherStatistics
+    {
+        MatcherStatistics() : latency(0.0), validFraction(0.0), samples(0), requestsSinceUse(0) {}
+
+        double latency; //running average in ms
+        double validFraction; //running average fraction of object pixels with a valid disparity
+        int samples;
+        int requestsSinceUse;
+    };
+
+    struct SearchWindow
+    {
+        int minDisparity;
+        int numberOfDisparities; //multiple of 16
+    };
+
+    cv::StereoSGBM stereo; //full search range, narrowed per call when priors are available
+    ParallelStereoSGBM parallelStereo; //runs stereo on row stripes across all cores
+    SparseStereoMatcher sparse;
+    PyramidStereoMatcher pyramid;
+    cv::StereoBM blockStereo;
+    Mode mode;
+    Matcher matcher;
+
+    double lastLatency;
+    Matcher lastMatcher;
+    double latencyBudget;
+    QMap<int, MatcherStatistics> matcherStatistics; //by Matcher
+
+    bool temporalPrior;
+    QMap<QString, DisparityPrior> priors; //per object, dropped when the measurement is not confident
+
+    SearchWindow fullWindow() const;
+    SearchWindow priorWindow(const StereoFrame &frame, const QString &object) const;
+    SearchWindow unite(const SearchWindow &a, const SearchWindow &b) const;
+    void updatePrior(const StereoFrame &frame, const QString &object, const DepthStatistics &depth,
+                     const SearchWindow &window);
+
+    QMap<QString, DepthStatistics> computeSparseDistances(const StereoFrame &frame,
+                                                          const QMap<QString, std::vector<cv::Point2f> > &objects);
+    QMap<QString, DepthStatistics> computeDenseDistances(const StereoFrame &frame,
+                                                         const QMap<QString, std::vector<cv::Point2f> > &objects,
+                                                         Matcher dense);
+
+    Matcher chooseMatcher();
+    void updateMatcherStatistics(Matcher used, const QMap<QString, DepthStatistics> &distances);
+
+    cv::Rect bandRect(const StereoFrame &frame, const cv::StereoSGBM &params, const cv::Rect &roi) const;
+    void computeFullDisparity(const StereoFrame &frame, const cv::StereoSGBM &params, cv::Mat &disp, cv::Rect &dispRect);
+    void computeBandDisparity(const StereoFrame &frame, const cv::StereoSGBM &params, const cv::Rect &roi,
+                              cv::Mat &disp, cv::Rect &dispRect);
+    void computeBlockDisparity(const StereoFrame &frame, const cv::StereoSGBM &params, const cv::Rect &roi,
+                               cv::Mat &disp, cv::Rect &dispRect);
+    void computePyramidDisparity(const StereoFrame &frame, const cv::StereoSGBM &params, const cv::Rect &roi,
+                                 cv::Mat &disp, cv::Rect &dispRect);
+
+};
+
+#endif // DEPTHENGINE_H
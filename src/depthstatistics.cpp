@@ -0,0 +1,134 @@
+#include "depthstatistics.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SORDE_SSE2
+#endif
+
+cv::Scalar DepthStatistics::toScalar() const
+{
+    return cv::Scalar(median, trimmedMean, validFraction, validCount);
+}
+
+DepthStatistics DepthStatistics::fromScalar(const cv::Scalar &value)
+{
+    DepthStatistics depth;
+    depth.median = static_cast<float>(value[0]);
+    depth.trimmedMean = static_cast<float>(value[1]);
+    depth.validFraction = static_cast<float>(value[2]);
+    depth.validCount = cvRound(value[3]);
+    return depth;
+}
+
+DepthStatistics roiDepthStatistics(const cv::Mat &disp, const cv::Rect &roi, const cv::Mat &Q,
+                                   int minDisparity, float trimFraction)
+{
+    cv::Rect area = roi & cv::Rect(0, 0, disp.cols, disp.rows);
+    if(area.area() == 0 || disp.type() != CV_16SC1 || Q.empty())
+    {
+        return DepthStatistics();
+    }
+
+    // Z = q23 / (q32 * d + q33) with d = disp / 16
+    cv::Mat_<double> q;
+    Q.convertTo(q, CV_64F);
+    const float q23 = (float)q(2, 3);
+    const float q32 = (float)q(3, 2) / 16.f;
+    const float q33 = (float)q(3, 3);
+
+    // Zero or negative W gives no usable depth
+    const float maxDepth = std::numeric_limits<float>::max();
+
+    // Matchers mark missing disparities with (minDisparity - 1) * 16
+    const short invalid = (short)((minDisparity - 1) * 16);
+
+    std::vector<float> depths;
+    depths.reserve(area.area());
+
+    std::vector<float> rowDepth(area.width + 8);
+
+    for(int y = area.y; y < area.y + area.height; y++)
+    {
+        const short *d = disp.ptr<short>(y) + area.x;
+        int x = 0;
+
+#ifdef SORDE_SSE2
+        const __m128i invalid8 = _mm_set1_epi16(invalid);
+        const __m128 q23_4 = _mm_set1_ps(q23), q32_4 = _mm_set1_ps(q32), q33_4 = _mm_set1_ps(q33);
+
+        for(; x + 8 <= area.width; x += 8)
+        {
+            __m128i d8 = _mm_loadu_si128((const __m128i*)(d + x));
+            int valid = _mm_movemask_epi8(_mm_cmpgt_epi16(d8, invalid8));
+            if(valid == 0)
+            {
+                continue;
+            }
+
+            // Sign-extend to 32 bits and evaluate Z for all eight lanes
+            __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(d8, d8), 16));
+            __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(d8, d8), 16));
+            _mm_storeu_ps(&rowDepth[x], _mm_div_ps(q23_4, _mm_add_ps(_mm_mul_ps(lo, q32_4), q33_4)));
+            _mm_storeu_ps(&rowDepth[x + 4], _mm_div_ps(q23_4, _mm_add_ps(_mm_mul_ps(hi, q32_4), q33_4)));
+
+            // Two mask bits per 16-bit lane
+            for(int i = 0; i < 8; i++)
+            {
+                float z = rowDepth[x + i];
+                if((valid & (1 << (2 * i))) && z > 0.f && z < maxDepth)
+                {
+                    depths.push_back(z);
+                }
+            }
+        }
+#endif
+
+        for(; x < area.width; x++)
+        {
+            if(d[x] > invalid)
+            {
+                float z = q23 / (d[x] * q32 + q33);
+                if(z > 0.f && z < maxDepth)
+                {
+                    depths.push_back(z);
+                }
+            }
+        }
+    }
+
+    return sampleDepthStatistics(depths, area.area(), trimFraction);
+}
+
+DepthStatistics sampleDepthStatistics(std::vector<float> &depths, int candidates, float trimFraction)
+{
+    DepthStatistics stats;
+
+    stats.validCount = depths.size();
+    stats.validFraction = candidates > 0 ? (float)depths.size() / candidates : 0.f;
+    if(depths.empty())
+    {
+        return stats;
+    }
+
+    // Partition once around the trim bounds, the median lies between them
+    int n = depths.size();
+    int lo = std::min((int)(n * trimFraction), (n - 1) / 2);
+    int hi = std::max(n - lo, lo + 1);
+    std::nth_element(depths.begin(), depths.begin() + lo, depths.end());
+    std::nth_element(depths.begin() + lo, depths.begin() + hi - 1, depths.end());
+    std::nth_element(depths.begin() + lo, depths.begin() + n / 2, depths.begin() + hi);
+
+    double sum = 0.0;
+    for(int i = lo; i < hi; i++)
+    {
+        sum += depths[i];
+    }
+
+    stats.median = depths[n / 2];
+    stats.trimmedMean = (float)(sum / (hi - lo));
+    return stats;
+}
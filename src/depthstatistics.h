@@ -0,0 +1,32 @@
+#ifndef DEPTHSTATISTICS_H
+#define DEPTHSTATISTICS_H
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+struct DepthStatistics
+{
+    DepthStatistics() : median(0.f), trimmedMean(0.f), validFraction(0.f), validCount(0) {}
+
+    float median; //depth in the units of the calibration (mm)
+    float trimmedMean; //mean without the nearest and farthest trimFraction of the samples
+    float validFraction; //fraction of roi pixels with a valid disparity
+    int validCount;
+
+    cv::Scalar toScalar() const; //(median, trimmedMean, validFraction, validCount)
+    static DepthStatistics fromScalar(const cv::Scalar &value); //inverse of toScalar
+};
+
+/* Depth statistics of a region of a fixed-point SGBM/BM disparity map (CV_16SC1, 4 fractional bits).
+ * Depth is computed directly from Q for the roi pixels only, pixels without a valid disparity are skipped.
+ * Q is expected in the layout produced by stereoRectify, where depth only depends on the disparity. */
+DepthStatistics roiDepthStatistics(const cv::Mat &disp, const cv::Rect &roi, const cv::Mat &Q,
+                                   int minDisparity, float trimFraction = 0.1f);
+
+/* Robust statistics of a set of depth samples, candidates is the number of samples that were tried.
+ * The samples are reordered. */
+DepthStatistics sampleDepthStatistics(std::vector<float> &depths, int candidates, float trimFraction = 0.1f);
+
+#endif // DEPTHSTATISTICS_H
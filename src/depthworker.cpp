@@ -0,0 +1,140 @@
+#include "depthworker.h"
+
+#include <algorithm>
+
+DepthWorker::DepthWorker()
+{
+    mode = DepthEngine::RoiBand;
+    matcher = DepthEngine::SemiGlobal;
+    cpuBudget = 0.5;
+
+    // The throttle measures wall-clock time, which is only the CPU time with the stripes on one worker
+    setSerial(true);
+}
+
+void DepthWorker::submit(const StereoFramePtr &frame, const QMap<QString, std::vector<cv::Point2f> > &objects)
+{
+    QMutexLocker locker(&inputMutex);
+
+    // An unprocessed older pair is dropped, releasing its pooled buffers
+    pendingFrame = frame;
+    pendingObjects = objects;
+    schedule();
+}
+
+double DepthWorker::getCpuBudget() const
+{
+    QMutexLocker locker(&inputMutex);
+    return cpuBudget;
+}
+
+void DepthWorker::setCpuBudget(double value)
+{
+    QMutexLocker locker(&inputMutex);
+    cpuBudget = std::min(std::max(value, 0.05), 1.0);
+}
+
+DepthEngine::Mode DepthWorker::getMode() const
+{
+    QMutexLocker locker(&inputMutex);
+    return mode;
+}
+
+void DepthWorker::setMode(DepthEngine::Mode value)
+{
+    QMutexLocker locker(&inputMutex);
+    mode = value;
+}
+
+DepthEngine::Matcher DepthWorker::getMatcher() const
+{
+    QMutexLocker locker(&inputMutex);
+    return matcher;
+}
+
+void DepthWorker::setMatcher(DepthEngine::Matcher value)
+{
+    QMutexLocker locker(&inputMutex);
+    matcher = value;
+}
+
+bool DepthWorker::hasPending() const
+{
+    return !pendingFrame.isNull();
+}
+
+void DepthWorker::takePending()
+{
+    frame = pendingFrame;
+    objects = pendingObjects;
+    clearPending();
+
+    engine.setMode(mode);
+    engine.setMatcher(matcher);
+}
+
+void DepthWorker::clearPending()
+{
+    pendingFrame.clear();
+    pendingObjects.clear();
+}
+
+void DepthWorker::process()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    try
+    {
+        double timestamp = frame->getTimestamp();
+
+        // Only objects whose predicted distance has become too uncertain are measured on this pair
+        QMap<QString, std::vector<cv::Point2f> > measured;
+        QMap<QString, std::vector<cv::Point2f> >::const_iterator objectIter;
+        for(objectIter = objects.begin(); objectIter != objects.end(); objectIter++)
+        {
+            if(tracker.needsMeasurement(objectIter.key(), timestamp))
+            {
+                measured[objectIter.key()] = objectIter.value();
+            }
+        }
+
+        if(!measured.isEmpty())
+        {
+            QMap<QString, DepthStatistics> depths = engine.computeDistances(*frame, measured);
+
+            QMap<QString, DepthStatistics>::const_iterator iter;
+            for(iter = depths.begin(); iter != depths.end(); iter++)
+            {
+                tracker.update(iter.key(), timestamp, iter.value());
+            }
+        }
+        tracker.removeStale(timestamp);
+
+        QMap<QString, cv::Scalar> distances;
+        for(objectIter = objects.begin(); objectIter != objects.end(); objectIter++)
+        {
+            float distance, velocity, sigma;
+            if(tracker.predict(objectIter.key(), timestamp, distance, velocity, sigma))
+            {
+                distances[objectIter.key()] = cv::Scalar(distance, velocity, sigma,
+                                                         measured.contains(objectIter.key()) ? 1 : 0);
+            }
+        }
+
+        //Inform GUI of the distances of this frame pair
+        emit objectDistances(distances);
+    }
+    catch(const cv::Exception& e)
+    {
+        emit sendMessage(QString::fromStdString(e.err), 2500);
+    }
+
+    // Hand the buffers back to the capture pool
+    frame.clear();
+    objects.clear();
+
+    // Pairs submitted while the worker idles replace each other, only the last one is processed
+    double budget = getCpuBudget();
+    defer((qint64)(timer.elapsed() * (1.0 / budget - 1.0)));
+}
@@ -0,0 +1,72 @@
+#ifndef DEPTHWORKER_H
+#define DEPTHWORKER_H
+
+//Qt
+#include <QElapsedTimer>
+#include <QMap>
+#include <QString>
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+
+//Local
+#include "stereoframe.h"
+#include "depthengine.h"
+#include "distancetracker.h"
+#include "streamingtask.h"
+
+#include <vector>
+
+/* Persistent worker streaming the distances of all detected objects.
+ * Frame pairs are submitted at camera rate, the worker always processes the latest one and drops the rest.
+ * Every object has a filtered distance track; disparity is only computed for the objects whose predicted
+ * distance has become too uncertain, and one disparity map per frame pair is shared by them. Each pair is
+ * processed on a single worker of the TaskScheduler, with no stripes on other workers, and the worker
+ * skips pairs after each one so that it uses at most cpuBudget of one core. */
+class DepthWorker : public StreamingTask
+{
+    Q_OBJECT
+public:
+
+    DepthWorker();
+
+    void submit(const StereoFramePtr &frame, const QMap<QString, std::vector<cv::Point2f> > &objects);
+
+    double getCpuBudget() const;
+    void setCpuBudget(double value); //fraction of one core, 1.0 runs unthrottled
+
+    DepthEngine::Mode getMode() const;
+    void setMode(DepthEngine::Mode value);
+
+    DepthEngine::Matcher getMatcher() const;
+    void setMatcher(DepthEngine::Matcher value);
+
+private:
+
+    StereoFramePtr pendingFrame; //latest submitted frame pair, replaced by newer ones until taken
+    QMap<QString, std::vector<cv::Point2f> > pendingObjects;
+
+    StereoFramePtr frame; //frame pair being processed
+    QMap<QString, std::vector<cv::Point2f> > objects;
+
+    DepthEngine engine;
+    DistanceTracker tracker;
+    DepthEngine::Mode mode;
+    DepthEngine::Matcher matcher;
+    double cpuBudget;
+
+protected:
+
+    bool hasPending() const;
+    void takePending();
+    void clearPending();
+    void process();
+
+signals:
+
+    void objectDistances(const QMap<QString, cv::Scalar> &distances); //(distance mm, velocity mm/s, sigma mm, 1 if measured on this pair)
+    void sendMessage(const QString &message, int timeout);
+
+};
+
+#endif // DEPTHWORKER_H
@@ -20,7 +20,7 @@ DictionaryDialog::DictionaryDialog(QWidget *parent, int deviceNumber, QString sv
     capture = cv::VideoCapture(this->deviceNumber);
     timer = new QTimer(this);
     connect(timer, SIGNAL(timeout()), this, SLOT(updateFrame()));
-    timer->start(10);
+    timer->start(displayRefreshInterval());
 
     selectTemplate = new SelectionWidget(this);
     ui->captureLayout->addWidget(selectTemplate);
@@ -55,10 +55,7 @@ void DictionaryDialog::updateFrame()
 {
     capture >> currentFrame;
 
-    frame = MatToQImage(currentFrame);
-    pixmap = QPixmap::fromImage(frame).scaled(currentFrame.cols,
-                                              currentFrame.rows, Qt::KeepAspectRatio);
-    selectTemplate->setPixmap(pixmap);
+    selectTemplate->setFrame(currentFrame);
 }
 
 void DictionaryDialog::on_saveButton_clicked()
@@ -118,7 +115,7 @@ void DictionaryDialog::on_captureButton_clicked()
     QString trImagesDirName = svmFolder + objectName + "/Training_Images/";
     QDir().mkdir(trImagesDirName);
     QString fileName = trImagesDirName + objectName + QString::number(++imageCounter) + ".jpg";
-    selectTemplate->pixmap()->copy(selectTemplate->getSelectionRect()).save(fileName);
+    selectTemplate->frame().copy(selectTemplate->getSelectionRect()).save(fileName);
     ui->nameLine->setText("Captured train image " + objectName + QString::number(imageCounter) + ".jpg");
 
 }
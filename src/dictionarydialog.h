@@ -49,10 +49,8 @@ private:
 
     int deviceNumber;
     cv::Mat currentFrame;
-    QImage frame;
 
     SelectionWidget *selectTemplate;
-    QPixmap pixmap;
 
     QString svmFolder;
     QString objectName;
@@ -2,34 +2,51 @@
 
 #include <QDebug>
 
+/* Training of the SVM of one category, see DictionaryThread::trainClassifier(). */
+class DictionaryThread::Training : public Task
+{
+public:
+
+    Training(DictionaryThread *dictionary, const QString &category, cv::SVM &svm) :
+        Task(Task::Background), dictionary(dictionary), category(category), svm(svm)
+    {
+    }
+
+protected:
+
+    void run()
+    {
+        dictionary->trainClassifier(category, svm);
+    }
+
+private:
+
+    DictionaryThread *dictionary;
+    QString category;
+    cv::SVM &svm; //entry of DictionaryThread::svms, the map is not changed while training
+};
+
 DictionaryThread::DictionaryThread(QString dataDir,
                                    QMap<QString, cv::Mat> templates,
                                    QMap<QString, cv::Mat> desc,
                                    QList<QString> categoryNames,
-                                   int clusters)
+                                   int clusters) :
+    ScheduledTask(Task::Background)
 {
     this->dataDir = dataDir;
     this->templates = templates;
     this->categoryNames = categoryNames;
     this->desc = desc;
 
-    featureDetector = new cv::SurfFeatureDetector(500);
+    featureDetector = new cv::SurfFeatureDetector(defaultHessianThreshold);
     descriptorExtractor = new cv::SurfDescriptorExtractor();
     bowtrainer = new cv::BOWKMeansTrainer(clusters);
     descriptorMatcher = new cv::FlannBasedMatcher();
     bowDescriptorExtractor = new cv::BOWImgDescriptorExtractor(descriptorExtractor, descriptorMatcher);
 
     progressCounter = 1;
-
-    doStop = false;
 }
 
-
-void DictionaryThread::stop()
-{
-    QMutexLocker locker(&doStopMutex);
-    doStop = true;
-}
 QMap<QString, cv::Mat> DictionaryThread::getTemplates() const
 {
     return templates;
@@ -63,22 +80,10 @@ void DictionaryThread::setDesc(const QMap<QString, cv::Mat> &value)
 
 void DictionaryThread::run()
 {
-    doStopMutex.lock();
-    if(doStop)
-    {
-        doStop = false;
-        doStopMutex.unlock();
-    }
-    doStopMutex.unlock();
-
-    processingMutex.lock();
-
     makeTrainSet();
     buildVocab();
     trainClassifiers();
 
-    processingMutex.unlock();
-
     // Inform GUI thread of new vocab and SVM
     emit doneGeneratingDictionary(svms, vocab);
 }
@@ -178,38 +183,55 @@ void DictionaryThread::trainClassifiers()
     // Extract BOW descriptors for all training images and organize them into positive and negative samples for each category
     makePosNeg();
 
+    // The map entries are created up front, the parallel trainings only write to their own SVM
     int categories = categoryNames.size();
+    QList<TaskPtr> trainings;
     for(int i = 0; i < categories; i++)
     {
-        QString category = categoryNames[i];
-        //Positive training data has labels 1
-        cv::Mat trainData = positiveData[category];
-        cv::Mat trainLabels = cv::Mat::ones(trainData.rows, 1, CV_32S);
-
-        //Negative training data has labels 0
-        trainData.push_back(negativeData[category]);
-        cv::Mat m = cv::Mat::zeros(negativeData[category].rows, 1, CV_32S);
-        trainLabels.push_back(m);
-
-        // SVM params
-        cv::SVMParams params;
-        params.kernel_type = cv::SVM::RBF;
-        params.svm_type = cv::SVM::C_SVC;
-        params.gamma = 0.50625000000000009;
-        params.C = 312.50000000000000;
-        params.term_crit = cv::TermCriteria(CV_TERMCRIT_ITER, 100, 0.000001);
-
-        // Train SVM
-        svms[category].train(trainData, trainLabels, cv::Mat(), cv::Mat(), params);
-
-        // Save SVM to file for reuse
-        QString svmFileName = dataDir + category + "SVM.xml";
-        svms[category].save(svmFileName.toStdString().c_str());
-
-        progressCounter = 100;
+        TaskPtr training(new Training(this, categoryNames[i], svms[categoryNames[i]]));
+        trainings.append(training);
+    }
+    for(int i = 0; i < trainings.size(); i++)
+    {
+        TaskScheduler::instance()->submit(trainings[i]);
+    }
+
+    for(int i = 0; i < trainings.size(); i++)
+    {
+        TaskScheduler::instance()->wait(trainings[i]);
+
+        progressCounter = 75 + 25 * (i + 1) / categories;
         emit updateProgress(progressCounter);
     }
 }
 
+void DictionaryThread::trainClassifier(const QString &category, cv::SVM &svm)
+{
+    //Positive training data has labels 1
+    cv::Mat trainData = positiveData.value(category).clone();
+    cv::Mat trainLabels = cv::Mat::ones(trainData.rows, 1, CV_32S);
+
+    //Negative training data has labels 0
+    cv::Mat negative = negativeData.value(category);
+    trainData.push_back(negative);
+    cv::Mat m = cv::Mat::zeros(negative.rows, 1, CV_32S);
+    trainLabels.push_back(m);
+
+    // SVM params
+    cv::SVMParams params;
+    params.kernel_type = cv::SVM::RBF;
+    params.svm_type = cv::SVM::C_SVC;
+    params.gamma = 0.50625000000000009;
+    params.C = 312.50000000000000;
+    params.term_crit = cv::TermCriteria(CV_TERMCRIT_ITER, 100, 0.000001);
+
+    // Train SVM
+    svm.train(trainData, trainLabels, cv::Mat(), cv::Mat(), params);
+
+    // Save SVM to file for reuse
+    QString svmFileName = dataDir + category + "SVM.xml";
+    svm.save(svmFileName.toStdString().c_str());
+}
+
 
 
@@ -2,14 +2,11 @@
 #define DICTIONARYTHREAD_H
 
 //Qt
-#include <QThread>
 #include <QMap>
 #include <QMultiMap>
 #include <QList>
 #include <QDir>
 #include <QDirIterator>
-#include <QMutex>
-#include <QMutexLocker>
 
 //OpenCV
 #include <opencv2/opencv.hpp>
@@ -17,7 +14,13 @@
 #include <opencv2/features2d/features2d.hpp>
 #include <opencv2/nonfree/features2d.hpp>
 
-class DictionaryThread : public QThread
+//Local
+#include "scheduledtask.h"
+#include "adaptivesurfdetector.h"
+
+/* Builds the BOW vocabulary and trains one SVM per category as a background task, the SVMs of all
+ * categories are trained in parallel. */
+class DictionaryThread : public ScheduledTask
 {
     Q_OBJECT
 public:
@@ -27,8 +30,6 @@ public:
                      QList<QString> categoryNames,
                      int clusters);
 
-    void stop();
-
     QMap<QString, cv::Mat> getTemplates() const;
     void setTemplates(const QMap<QString, cv::Mat> &value);
 
@@ -42,9 +43,7 @@ private:
 
     int progressCounter;
 
-    volatile bool doStop;
-    QMutex doStopMutex;
-    QMutex processingMutex;
+    class Training;
 
     QString dataDir;
     QMap<QString, cv::Mat> templates;
@@ -66,6 +65,7 @@ private:
     void makePosNeg(); //method to extract BOW features from training images and organize them into positive and negative samples
     void buildVocab(); //method to build the BOW vocabulary
     void trainClassifiers(); //method to train the one-vs-all SVM classifiers for all categories
+    void trainClassifier(const QString &category, cv::SVM &svm); //one-vs-all SVM of one category
 
     void findFilesRecursively(QDir rootDir);
 
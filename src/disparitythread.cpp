@@ -2,66 +2,23 @@
 
 #include<QDebug>
 
-DisparityThread::DisparityThread(cv::Mat framel, cv::Mat framer, cv::Mat map_l1,
-                                 cv::Mat map_l2, cv::Mat map_r1, cv::Mat map_r2,
-                                 cv::Mat Q, cv::Size imageSize,
-                                 std::vector<cv::Point2f> detectedObject, QString category)
+DisparityThread::DisparityThread(StereoFramePtr frame, std::vector<cv::Point2f> detectedObject, QString category) :
+    ScheduledTask(Task::Interactive)
 {
-    this->framel = framel;
-    this->framer = framer;
-
-    this->map_l1 = map_l1;
-    this->map_l2 = map_l2;
-    this->map_r1 = map_r1;
-    this->map_r2 = map_r2;
-    this->Q = Q;
+    this->frame = frame;
 
     this->category = category;
 
-    this->imageSize = imageSize;
-
     this->detectedObject = detectedObject;
-
-    stereo.preFilterCap = 63;
-    stereo.SADWindowSize = 3;
-
-    int cn = framel.channels();
-
-    stereo.P1 = 8*cn*stereo.SADWindowSize*stereo.SADWindowSize;
-    stereo.P2 = 32*cn*stereo.SADWindowSize*stereo.SADWindowSize;
-    stereo.minDisparity = 16;
-    stereo.numberOfDisparities = 96;
-    stereo.uniquenessRatio = 10;
-    stereo.speckleWindowSize = 100;
-    stereo.speckleRange = 32;
-    stereo.disp12MaxDiff = 1;
-    stereo.fullDP = false;
-
-    doStop = false;
-}
-
-void DisparityThread::stop()
-{
-    QMutexLocker locker(&doStopMutex);
-    doStop = true;
-}
-cv::Mat DisparityThread::getFramel() const
-{
-    return framel;
 }
-
-void DisparityThread::setFramel(const cv::Mat &value)
+StereoFramePtr DisparityThread::getFrame() const
 {
-    framel = value;
-}
-cv::Mat DisparityThread::getFramer() const
-{
-    return framer;
+    return frame;
 }
 
-void DisparityThread::setFramer(const cv::Mat &value)
+void DisparityThread::setFrame(const StereoFramePtr &value)
 {
-    framer = value;
+    frame = value;
 }
 QString DisparityThread::getCategory() const
 {
@@ -72,15 +29,6 @@ void DisparityThread::setCategory(const QString &value)
 {
     category = value;
 }
-cv::Size DisparityThread::getImageSize() const
-{
-    return imageSize;
-}
-
-void DisparityThread::setImageSize(const cv::Size &value)
-{
-    imageSize = value;
-}
 std::vector<cv::Point2f> DisparityThread::getDetectedObject() const
 {
     return detectedObject;
@@ -91,59 +39,53 @@ void DisparityThread::setDetectedObject(const std::vector<cv::Point2f> &value)
     detectedObject = value;
 }
 
+DepthEngine::Mode DisparityThread::getMode() const
+{
+    return engine.getMode();
+}
 
+void DisparityThread::setMode(DepthEngine::Mode value)
+{
+    engine.setMode(value);
+}
 
+DepthEngine::Matcher DisparityThread::getMatcher() const
+{
+    return engine.getMatcher();
+}
 
-
+void DisparityThread::setMatcher(DepthEngine::Matcher value)
+{
+    engine.setMatcher(value);
+}
 
 void DisparityThread::run()
 {
-    doStopMutex.lock();
-    if(doStop)
+    try
     {
-        doStop = false;
-        doStopMutex.unlock();
-    }
-    doStopMutex.unlock();
-
-    processingMutex.lock();
+        QMap<QString, std::vector<cv::Point2f> > objects;
+        objects[category] = detectedObject;
 
-    cv::Mat frameLeftRect, frameRightRect;
+        QMap<QString, DepthStatistics> distances = engine.computeDistances(*frame, objects);
 
-    if(!framel.empty() && !framer.empty())
-    {
-
-        cv::remap(framer, frameRightRect, map_r1, map_r2, cv::INTER_LINEAR);
-        cv::remap(framel, frameLeftRect, map_l1, map_l2, cv::INTER_LINEAR);
-
-        try
+        //Inform GUI of distance to object
+        if(distances.contains(category) && distances[category].validCount > 0)
         {
-            cv::Mat disp, dispCompute, pointCloud;
-            stereo(frameLeftRect, frameRightRect, disp);
-            disp.convertTo(dispCompute, CV_32F, 1.f/16.f);
-
-            //Calculate 3D co-ordinates from disparity image
-            cv::reprojectImageTo3D(dispCompute, pointCloud, Q, true);
-            float xmin = detectedObject[0].x;
-            float ymin = detectedObject[0].y;
-            float xmax = detectedObject[2].x;
-            float ymax = detectedObject[2].y;
-
-            // Extract depth of rectangle and inform gui of their mean
-            pointCloud = pointCloud(cv::Range(ymin, ymax), cv::Range(xmin, xmax));
-            cv::Mat z_roi(pointCloud.size(), CV_32FC1);
-            int fromTo[] = {2, 0};
-            cv::mixChannels(&pointCloud, 1, &z_roi, 1, fromTo, 1);
-
-            processingMutex.unlock();
-
-            //Inform GUI of distance to object
-            emit objectDistance(cv::mean(z_roi), category);
+            emit objectDistance(distances[category].toScalar(), category, frame->getTimestamp());
+            emit sendMessage("Distance to " + category + " computed in " +
+                             QString::number(engine.getLastLatency(), 'f', 1) + " ms with " +
+                             DepthEngine::matcherName(engine.getLastMatcher()), 2500);
         }
-        catch(const cv::Exception& e)
+        else if(distances.contains(category))
         {
-            emit sendMessage(QString::fromStdString(e.err), 2500);
+            emit sendMessage("No valid disparity found for " + category, 2500);
         }
     }
+    catch(const cv::Exception& e)
+    {
+        emit sendMessage(QString::fromStdString(e.err), 2500);
+    }
 
+    // Hand the buffers back to the capture pool
+    frame.clear();
 }
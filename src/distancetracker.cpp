@@ -0,0 +1,155 @@
+#include "distancetracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Acceleration noise of a hand-held camera or a walking person, mm/s^2
+static const float accelerationNoise = 1000.f;
+
+// Measurement noise: a fixed part and a part growing with the distance, in mm
+static const float measurementNoise = 5.f;
+static const float relativeMeasurementNoise = 0.01f;
+
+// Uncertainty never drops below this when deciding whether to measure again, in mm
+static const float minSigma = 10.f;
+
+DistanceTracker::DistanceTracker()
+{
+    maxSigma = 0.03f;
+    maxInterval = 1000.0;
+    maxTrackAge = 2000.0;
+}
+
+void DistanceTracker::transition(double dt, cv::Mat &F, cv::Mat &Q)
+{
+    float t = (float)(dt / 1000.0);
+    F = (cv::Mat_<float>(2, 2) << 1.f, t, 0.f, 1.f);
+
+    // Piecewise constant white acceleration
+    float q = accelerationNoise * accelerationNoise;
+    Q = (cv::Mat_<float>(2, 2) << q * t * t * t * t / 4.f, q * t * t * t / 2.f,
+                                  q * t * t * t / 2.f,     q * t * t);
+}
+
+void DistanceTracker::update(const QString &object, double timestamp, const DepthStatistics &depth)
+{
+    if(depth.validCount == 0 || depth.median <= 0.f)
+    {
+        return;
+    }
+
+    // Fewer valid pixels make a noisier measurement
+    float sigma = (measurementNoise + relativeMeasurementNoise * depth.median) /
+                  std::sqrt(std::max(depth.validFraction, 0.05f));
+    cv::Mat R = (cv::Mat_<float>(1, 1) << sigma * sigma);
+
+    if(!tracks.contains(object))
+    {
+        Track track;
+        track.filter.init(2, 1, 0, CV_32F);
+        track.filter.measurementMatrix = (cv::Mat_<float>(1, 2) << 1.f, 0.f);
+        track.filter.statePost = (cv::Mat_<float>(2, 1) << depth.median, 0.f);
+        track.filter.errorCovPost = (cv::Mat_<float>(2, 2) << sigma * sigma, 0.f, 0.f, 500.f * 500.f);
+        track.timestamp = timestamp;
+        track.measured = timestamp;
+        tracks[object] = track;
+        return;
+    }
+
+    Track &track = tracks[object];
+
+    // Measurements older than the track state (late results of a slow matcher) are fused at the track time
+    double dt = std::max(timestamp - track.timestamp, 0.0);
+    transition(dt, track.filter.transitionMatrix, track.filter.processNoiseCov);
+    track.filter.measurementNoiseCov = R;
+    track.filter.predict();
+    track.filter.correct((cv::Mat_<float>(1, 1) << depth.median));
+
+    track.timestamp = std::max(timestamp, track.timestamp);
+    track.measured = track.timestamp;
+}
+
+bool DistanceTracker::predict(const QString &object, double timestamp, float &distance, float &velocity,
+                              float &sigma) const
+{
+    QMap<QString, Track>::const_iterator iter = tracks.find(object);
+    if(iter == tracks.end())
+    {
+        return false;
+    }
+
+    const Track &track = iter.value();
+    cv::Mat F, Q;
+    transition(std::max(timestamp - track.timestamp, 0.0), F, Q);
+
+    // Prediction without touching the filter state
+    cv::Mat x = F * track.filter.statePost;
+    cv::Mat P = F * track.filter.errorCovPost * F.t() + Q;
+
+    distance = x.at<float>(0);
+    velocity = x.at<float>(1);
+    sigma = std::sqrt(std::max(P.at<float>(0, 0), 0.f));
+    return true;
+}
+
+bool DistanceTracker::needsMeasurement(const QString &object, double timestamp) const
+{
+    float distance, velocity, sigma;
+    if(!predict(object, timestamp, distance, velocity, sigma))
+    {
+        return true;
+    }
+
+    if(timestamp - tracks.find(object).value().measured >= maxInterval)
+    {
+        return true;
+    }
+
+    return sigma > std::max(minSigma, maxSigma * distance);
+}
+
+void DistanceTracker::removeStale(double timestamp)
+{
+    QMap<QString, Track>::iterator iter = tracks.begin();
+    while(iter != tracks.end())
+    {
+        if(timestamp - iter.value().measured > maxTrackAge)
+        {
+            iter = tracks.erase(iter);
+        }
+        else
+        {
+            iter++;
+        }
+    }
+}
+
+bool DistanceTracker::contains(const QString &object) const
+{
+    return tracks.contains(object);
+}
+
+void DistanceTracker::clear()
+{
+    tracks.clear();
+}
+
+float DistanceTracker::getMaxSigma() const
+{
+    return maxSigma;
+}
+
+void DistanceTracker::setMaxSigma(float value)
+{
+    maxSigma = std::max(value, 0.001f);
+}
+
+double DistanceTracker::getMaxInterval() const
+{
+    return maxInterval;
+}
+
+void DistanceTracker::setMaxInterval(double value)
+{
+    maxInterval = std::max(value, 0.0);
+}
@@ -0,0 +1,58 @@
+#ifndef DISTANCETRACKER_H
+#define DISTANCETRACKER_H
+
+//Qt
+#include <QMap>
+#include <QString>
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+#include <opencv2/video/tracking.hpp>
+
+//Local
+#include "depthstatistics.h"
+
+/* Per-object distance tracks fusing successive measurements with a constant-velocity Kalman filter.
+ * Between measurements the tracks predict the distance, and the growing uncertainty of the prediction
+ * tells when a fresh disparity measurement is worth its cost. Timestamps are in ms, see captureTimestamp(). */
+class DistanceTracker
+{
+public:
+
+    DistanceTracker();
+
+    void update(const QString &object, double timestamp, const DepthStatistics &depth); //fuse a measurement
+    bool predict(const QString &object, double timestamp, float &distance, float &velocity, float &sigma) const;
+
+    bool needsMeasurement(const QString &object, double timestamp) const;
+    void removeStale(double timestamp); //drop tracks without a measurement for maxTrackAge
+
+    bool contains(const QString &object) const;
+    void clear();
+
+    float getMaxSigma() const;
+    void setMaxSigma(float value); //relative prediction uncertainty that asks for a new measurement
+
+    double getMaxInterval() const;
+    void setMaxInterval(double value); //ms between measurements even when the prediction is certain
+
+private:
+
+    struct Track
+    {
+        cv::KalmanFilter filter; //state (distance mm, velocity mm/s)
+        double timestamp; //time of the filter state
+        double measured; //time of the last measurement
+    };
+
+    QMap<QString, Track> tracks;
+
+    float maxSigma;
+    double maxInterval;
+    double maxTrackAge;
+
+    static void transition(double dt, cv::Mat &F, cv::Mat &Q);
+
+};
+
+#endif // DISTANCETRACKER_H
@@ -0,0 +1,134 @@
+#include "framepool.h"
+
+FrameLease::FrameLease()
+{
+    pool = NULL;
+    index = -1;
+}
+
+FrameLease::FrameLease(FramePool *pool, int index)
+{
+    // Takes over the reference handed out by FramePool::acquire()
+    this->pool = pool;
+    this->index = index;
+}
+
+FrameLease::FrameLease(const FrameLease &other)
+{
+    pool = other.pool;
+    index = other.index;
+    if(pool != NULL)
+    {
+        pool->addRef(index);
+    }
+}
+
+FrameLease::~FrameLease()
+{
+    release();
+}
+
+FrameLease &FrameLease::operator=(const FrameLease &other)
+{
+    if(pool != other.pool || index != other.index)
+    {
+        if(other.pool != NULL)
+        {
+            other.pool->addRef(other.index);
+        }
+        release();
+        pool = other.pool;
+        index = other.index;
+    }
+    return *this;
+}
+
+const cv::Mat &FrameLease::image() const
+{
+    static const cv::Mat empty;
+    return pool != NULL ? pool->buffers[index] : empty;
+}
+
+bool FrameLease::isNull() const
+{
+    return pool == NULL;
+}
+
+void FrameLease::release()
+{
+    if(pool != NULL)
+    {
+        pool->releaseRef(index);
+        pool = NULL;
+        index = -1;
+    }
+}
+
+FramePool::FramePool(int capacity)
+{
+    buffers.resize(capacity);
+    refCounts = new QAtomicInt[capacity];
+}
+
+FramePool::~FramePool()
+{
+    delete[] refCounts;
+}
+
+void FramePool::preallocate(cv::Size size, int type)
+{
+    for(size_t i = 0; i < buffers.size(); i++)
+    {
+        // Leased buffers are left alone, they are resized by their next capture
+        if(refCounts[i].load() == 0)
+        {
+            buffers[i].create(size, type);
+        }
+    }
+}
+
+FrameLease FramePool::acquire()
+{
+    for(size_t i = 0; i < buffers.size(); i++)
+    {
+        if(refCounts[i].testAndSetAcquire(0, 1))
+        {
+            return FrameLease(this, i);
+        }
+    }
+    return FrameLease();
+}
+
+void FramePool::write(const FrameLease &lease, const cv::Mat &image)
+{
+    // Copied into the pooled storage, which is only reallocated when the frame size or type changes
+    image.copyTo(buffers[lease.index]);
+}
+
+int FramePool::capacity() const
+{
+    return buffers.size();
+}
+
+int FramePool::available() const
+{
+    int count = 0;
+    for(size_t i = 0; i < buffers.size(); i++)
+    {
+        if(refCounts[i].load() == 0)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+void FramePool::addRef(int index)
+{
+    refCounts[index].ref();
+}
+
+void FramePool::releaseRef(int index)
+{
+    refCounts[index].deref();
+}
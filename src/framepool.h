@@ -0,0 +1,70 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+//Qt
+#include <QAtomicInt>
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+class FramePool;
+
+/* Read-only lease on a pooled frame buffer.
+ * Copying a lease adds a reference, the buffer goes back to the pool when the last lease is released. */
+class FrameLease
+{
+public:
+
+    FrameLease();
+    FrameLease(const FrameLease &other);
+    ~FrameLease();
+
+    FrameLease &operator=(const FrameLease &other);
+
+    const cv::Mat &image() const;
+    bool isNull() const;
+    void release();
+
+private:
+
+    friend class FramePool;
+
+    FrameLease(FramePool *pool, int index);
+
+    FramePool *pool;
+    int index;
+
+};
+
+/* Fixed set of frame buffers with explicit reference counts.
+ * Buffers keep their allocation while they cycle between producer and consumers, so the
+ * capture loop does no malloc/free once every buffer has been filled. The pool must outlive its leases. */
+class FramePool
+{
+public:
+
+    FramePool(int capacity = 16);
+    ~FramePool();
+
+    void preallocate(cv::Size size, int type); //allocate every buffer up front
+    FrameLease acquire(); //free buffer holding a single reference, null lease if all buffers are leased
+    void write(const FrameLease &lease, const cv::Mat &image); //producer access, only valid before the lease is shared
+
+    int capacity() const;
+    int available() const;
+
+private:
+
+    friend class FrameLease;
+
+    void addRef(int index);
+    void releaseRef(int index);
+
+    std::vector<cv::Mat> buffers;
+    QAtomicInt *refCounts;
+
+};
+
+#endif // FRAMEPOOL_H
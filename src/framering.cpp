@@ -0,0 +1,69 @@
+#include "framering.h"
+
+#include <algorithm>
+#include <cmath>
+
+FrameRing::FrameRing(int capacity)
+{
+    frames.resize(std::max(capacity, 1));
+    head = 0;
+    count = 0;
+    sequence = 0;
+}
+
+void FrameRing::push(const FrameLease &frame, double timestamp)
+{
+    QMutexLocker locker(&mutex);
+
+    // Overwriting the slot releases the ring's lease on the oldest frame
+    frames[head].frame = frame;
+    frames[head].timestamp = timestamp;
+    frames[head].sequence = sequence++;
+
+    head = (head + 1) % frames.size();
+    count = std::min(count + 1, (int)frames.size());
+}
+
+bool FrameRing::latest(TimestampedFrame &frame) const
+{
+    QMutexLocker locker(&mutex);
+
+    if(count == 0)
+    {
+        return false;
+    }
+
+    frame = frames[(head + frames.size() - 1) % frames.size()];
+    return true;
+}
+
+bool FrameRing::nearest(double timestamp, TimestampedFrame &frame) const
+{
+    QMutexLocker locker(&mutex);
+
+    int best = -1;
+    double bestDelta = 0.0;
+    for(int i = 1; i <= count; i++)
+    {
+        int slot = (head + frames.size() - i) % frames.size();
+        double delta = std::fabs(frames[slot].timestamp - timestamp);
+        if(best == -1 || delta < bestDelta)
+        {
+            best = slot;
+            bestDelta = delta;
+        }
+    }
+
+    if(best == -1)
+    {
+        return false;
+    }
+
+    frame = frames[best];
+    return true;
+}
+
+int FrameRing::capacity() const
+{
+    return frames.size();
+}
@@ -0,0 +1,51 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+//Qt
+#include <QMutex>
+#include <QMutexLocker>
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+
+//Local
+#include "framepool.h"
+
+#include <vector>
+
+struct TimestampedFrame
+{
+    TimestampedFrame() : timestamp(0.0), sequence(-1) {}
+
+    FrameLease frame; //read-only lease on the pooled image
+    double timestamp; //capture time in ms, see captureTimestamp()
+    qint64 sequence; //running frame number of the camera
+};
+
+/* Fixed-size ring of the most recent timestamped frames of one camera.
+ * The ring holds a lease on every frame it keeps, readers get further leases instead of copies. */
+class FrameRing
+{
+public:
+
+    FrameRing(int capacity = 4);
+
+    void push(const FrameLease &frame, double timestamp); //publish a frame, dropping the oldest one
+
+    bool latest(TimestampedFrame &frame) const; //most recent frame
+    bool nearest(double timestamp, TimestampedFrame &frame) const; //frame captured closest to timestamp
+
+    int capacity() const;
+
+private:
+
+    mutable QMutex mutex;
+
+    std::vector<TimestampedFrame> frames;
+    int head; //slot the next frame is written to
+    int count; //number of published frames
+    qint64 sequence;
+
+};
+
+#endif // FRAMERING_H
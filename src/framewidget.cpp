@@ -0,0 +1,83 @@
+#include "framewidget.h"
+#include "utilities.h"
+
+#include <QPainter>
+#include <QStyle>
+
+FrameWidget::FrameWidget(QWidget *parent)
+    : QLabel(parent)
+{
+    backBuffer = 0;
+}
+
+cv::Mat FrameWidget::frameBuffer(cv::Size size)
+{
+    QImage &image = buffers[backBuffer];
+    if(image.width() != size.width || image.height() != size.height)
+    {
+        image = QImage(size.width, size.height, QImage::Format_RGB32);
+    }
+
+    // The front buffer is the only one handed to the paint engine, so this does not detach
+    return cv::Mat(image.height(), image.width(), CV_8UC4, image.bits(), image.bytesPerLine());
+}
+
+void FrameWidget::presentFrame()
+{
+    QSize previousSize = buffers[backBuffer ^ 1].size();
+    backBuffer ^= 1;
+
+    if(buffers[backBuffer ^ 1].size() != previousSize)
+    {
+        updateGeometry();
+    }
+
+    // update() coalesces, several frames presented before the next paint cost a single repaint
+    update();
+}
+
+void FrameWidget::setFrame(const cv::Mat &frame)
+{
+    if(frame.empty())
+    {
+        return;
+    }
+
+    cv::Mat buffer = frameBuffer(frame.size());
+    bgrToRgb32(frame, buffer);
+    presentFrame();
+}
+
+QImage FrameWidget::frame() const
+{
+    return buffers[backBuffer ^ 1];
+}
+
+QSize FrameWidget::sizeHint() const
+{
+    const QImage &image = buffers[backBuffer ^ 1];
+    if(image.isNull())
+    {
+        return QLabel::sizeHint();
+    }
+    return image.size() + QSize(2 * margin() + frameWidth() * 2, 2 * margin() + frameWidth() * 2);
+}
+
+QSize FrameWidget::minimumSizeHint() const
+{
+    return sizeHint();
+}
+
+void FrameWidget::paintEvent(QPaintEvent *e)
+{
+    const QImage &image = buffers[backBuffer ^ 1];
+    if(image.isNull())
+    {
+        QLabel::paintEvent(e);
+        return;
+    }
+
+    QPainter painter(this);
+    QRect target = QStyle::alignedRect(layoutDirection(), alignment(), image.size(), contentsRect());
+    painter.drawImage(target.topLeft(), image);
+}
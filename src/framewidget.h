@@ -0,0 +1,42 @@
+#ifndef FRAMEWIDGET_H
+#define FRAMEWIDGET_H
+
+//Qt
+#include <QLabel>
+#include <QImage>
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+
+/* Label that paints camera frames straight from a pair of reused QImage buffers.
+ * Frames are rendered into the back buffer in QImage::Format_RGB32 layout (BGRX in memory),
+ * which the raster engine draws without any conversion, then presented by swapping buffers. */
+class FrameWidget : public QLabel
+{
+    Q_OBJECT
+
+public:
+
+    FrameWidget(QWidget *parent = 0);
+
+    cv::Mat frameBuffer(cv::Size size); //CV_8UC4 view of the back buffer, reallocated only when the size changes
+    void presentFrame(); //show the back buffer and schedule a repaint
+    void setFrame(const cv::Mat &frame); //convert a BGR or gray frame into the back buffer and present it
+
+    QImage frame() const; //currently displayed frame
+
+    QSize sizeHint() const;
+    QSize minimumSizeHint() const;
+
+protected:
+
+    void paintEvent(QPaintEvent *e);
+
+private:
+
+    QImage buffers[2];
+    int backBuffer;
+
+};
+
+#endif // FRAMEWIDGET_H
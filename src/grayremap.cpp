@@ -0,0 +1,143 @@
+#include "grayremap.h"
+#include "taskscheduler.h"
+
+#include <algorithm>
+
+#if defined(__SSSE3__) || (defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64)))
+#include <tmmintrin.h>
+#define SORDE_SSSE3
+#endif
+
+// Interpolation weights have INTER_BITS (5) fractional bits per axis, the luma coefficients 10 bits
+static const int interBits = 5;
+static const int interTabSize = 1 << interBits;
+static const int lumaBits = 10;
+static const int lumaB = 117, lumaG = 601, lumaR = 306; //sum to 1 << lumaBits
+static const int resultShift = 2 * interBits + lumaBits;
+
+/* Remaps a range of row stripes of the output. */
+class GrayRemapStripes : public cv::ParallelLoopBody
+{
+public:
+
+    GrayRemapStripes(const cv::Mat &src, const cv::Mat &map1, const cv::Mat &map2, int stripeHeight, cv::Mat &dst) :
+        src(src), map1(map1), map2(map2), stripeHeight(stripeHeight), dst(dst)
+    {
+    }
+
+    void operator()(const cv::Range &range) const
+    {
+#ifdef SORDE_SSSE3
+        bool ssse3 = cv::checkHardwareSupport(CV_CPU_SSSE3);
+
+        // B0 B1 G0 G1 R0 R1 of both source rows, the horizontal weights are applied with pmaddubsw
+        const __m128i gather = _mm_setr_epi8(0, 3, 1, 4, 2, 5, -1, -1, 8, 11, 9, 12, 10, 13, -1, -1);
+        __m128i horizontal[interTabSize], vertical[interTabSize];
+        for(int f = 0; f < interTabSize; f++)
+        {
+            char a = (char)(interTabSize - f), b = (char)f;
+            horizontal[f] = _mm_setr_epi8(a, b, a, b, a, b, 0, 0, a, b, a, b, a, b, 0, 0);
+
+            short top = (short)(interTabSize - f), bottom = (short)f;
+            vertical[f] = _mm_setr_epi16(top * lumaB, top * lumaG, top * lumaR, 0,
+                                         bottom * lumaB, bottom * lumaG, bottom * lumaR, 0);
+        }
+        const __m128i round = _mm_setr_epi32(1 << (resultShift - 1), 0, 0, 0);
+#endif
+
+        for(int stripe = range.start; stripe < range.end; stripe++)
+        {
+            int y0 = stripe * stripeHeight;
+            int y1 = std::min(y0 + stripeHeight, dst.rows);
+
+            for(int y = y0; y < y1; y++)
+            {
+                const short *xy = map1.ptr<short>(y);
+                const ushort *weights = map2.ptr<ushort>(y);
+                uchar *d = dst.ptr<uchar>(y);
+
+                for(int x = 0; x < dst.cols; x++)
+                {
+                    int sx = xy[2 * x], sy = xy[2 * x + 1];
+                    int w = weights[x] & (interTabSize * interTabSize - 1);
+                    int fx = w & (interTabSize - 1), fy = w >> interBits;
+
+#ifdef SORDE_SSSE3
+                    // The 8-byte loads stay inside the row while the pair starts 3 pixels before its end
+                    if(ssse3 && sx >= 0 && sx <= src.cols - 3 && sy >= 0 && sy < src.rows - 1)
+                    {
+                        const uchar *s0 = src.ptr<uchar>(sy) + 3 * sx;
+                        const uchar *s1 = src.ptr<uchar>(sy + 1) + 3 * sx;
+                        __m128i pixels = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)s0),
+                                                            _mm_loadl_epi64((const __m128i*)s1));
+                        __m128i rows = _mm_maddubs_epi16(_mm_shuffle_epi8(pixels, gather), horizontal[fx]);
+                        __m128i sum = _mm_add_epi32(_mm_madd_epi16(rows, vertical[fy]), round);
+                        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+                        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+                        d[x] = (uchar)(_mm_cvtsi128_si32(sum) >> resultShift);
+                        continue;
+                    }
+#endif
+
+                    d[x] = interpolate(sx, sy, fx, fy);
+                }
+            }
+        }
+    }
+
+private:
+
+    cv::Mat src, map1, map2;
+    int stripeHeight;
+    cv::Mat dst;
+
+    // Taps outside the source are black, as with BORDER_CONSTANT
+    int luma(int x, int y) const
+    {
+        if(x < 0 || x >= src.cols || y < 0 || y >= src.rows)
+        {
+            return 0;
+        }
+
+        const uchar *p = src.ptr<uchar>(y) + 3 * x;
+        return lumaB * p[0] + lumaG * p[1] + lumaR * p[2];
+    }
+
+    uchar interpolate(int sx, int sy, int fx, int fy) const
+    {
+        int top = (interTabSize - fx) * luma(sx, sy) + fx * luma(sx + 1, sy);
+        int bottom = (interTabSize - fx) * luma(sx, sy + 1) + fx * luma(sx + 1, sy + 1);
+        int sum = (interTabSize - fy) * top + fy * bottom;
+        return (uchar)((sum + (1 << (resultShift - 1))) >> resultShift);
+    }
+};
+
+void remapToGray(const cv::Mat &src, const cv::Mat &map1, const cv::Mat &map2, cv::Mat &dst)
+{
+    if(src.type() != CV_8UC3 || map1.type() != CV_16SC2 || map2.type() != CV_16UC1 || map1.size() != map2.size())
+    {
+        cv::Mat remapped;
+        cv::remap(src, remapped, map1, map2, cv::INTER_LINEAR);
+        if(remapped.channels() == 3)
+        {
+            cv::cvtColor(remapped, dst, CV_BGR2GRAY);
+        }
+        else
+        {
+            dst = remapped;
+        }
+        return;
+    }
+
+    dst.create(map1.size(), CV_8UC1);
+
+    int stripes = std::min(dst.rows, std::max(1, TaskScheduler::instance()->parallelism() * 4));
+    if(stripes == 0)
+    {
+        return;
+    }
+    int stripeHeight = (dst.rows + stripes - 1) / stripes;
+    stripes = (dst.rows + stripeHeight - 1) / stripeHeight;
+
+    TaskScheduler::instance()->parallelFor(cv::Range(0, stripes), GrayRemapStripes(src, map1, map2, stripeHeight, dst));
+}
@@ -0,0 +1,14 @@
+#ifndef GRAYREMAP_H
+#define GRAYREMAP_H
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+
+/* Remaps a BGR image and converts it to grayscale in a single pass (INTER_LINEAR, BORDER_CONSTANT 0).
+ * The fixed-point maps of initUndistortRectifyMap (CV_16SC2 + CV_16UC1) are read directly, every output
+ * pixel interpolates its four source pixels with the 5-bit table weights and weights the channels with
+ * the BT.601 luma coefficients in integer arithmetic. Sub-rectangles of the maps remap only that part of
+ * the image. Other map types or grayscale sources fall back to cv::remap. */
+void remapToGray(const cv::Mat &src, const cv::Mat &map1, const cv::Mat &map2, cv::Mat &dst);
+
+#endif // GRAYREMAP_H
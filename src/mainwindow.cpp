@@ -1,6 +1,8 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
+#include <algorithm>
+
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow)
@@ -28,11 +30,7 @@ MainWindow::MainWindow(QWidget *parent) :
         this->rightCamera = 1;
     }
 
-    this->map_l1 = stereoCameraDialog->getMap_l1();
-    this->map_l2 = stereoCameraDialog->getMap_l2();
-    this->map_r1 = stereoCameraDialog->getMap_r1();
-    this->map_r2 = stereoCameraDialog->getMap_r2();
-    this->Q = stereoCameraDialog->getQ();
+    this->calibration = stereoCameraDialog->getCalibration();
 
     loadSamples();
     populateList();
@@ -40,20 +38,29 @@ MainWindow::MainWindow(QWidget *parent) :
     progressBar = new QProgressBar(ui->statusBar);
     ui->statusBar->addPermanentWidget(progressBar);
     progressBar->hide();
-
-    captureLeft = cv::VideoCapture(this->leftCamera);
-    if(!captureLeft.isOpened())
-    {
-        captureLeft.open(this->leftCamera);
-    }
-    captureRight = cv::VideoCapture(this->rightCamera);
-    if(!captureRight.isOpened())
-    {
-        captureRight.open(this->rightCamera);
-    }
+    // Exactly one distance matcher is selected at a time
+    QActionGroup *matcherGroup = new QActionGroup(this);
+    matcherGroup->addAction(ui->actionSemi_Global_Matching);
+    matcherGroup->addAction(ui->actionSparse_Keypoint_Matching);
+    matcherGroup->addAction(ui->actionCoarse_to_Fine_Matching);
+    matcherGroup->addAction(ui->actionBlock_Matching);
+    matcherGroup->addAction(ui->actionAutomatic_Matcher);
+
+    latencyLabel = new QLabel(ui->statusBar);
+    ui->statusBar->addPermanentWidget(latencyLabel);
+
+    currentSequence = -1;
+    sparseDepthSequence = -1;
+
+    // Cameras are grabbed on their own threads, the timer only picks up the latest frame pair
+    stereoCapture = new StereoCapture(this->leftCamera, this->rightCamera, this);
+    connect(stereoCapture, SIGNAL(sendMessage(QString,int)), this, SLOT(setMessage(QString,int)));
+    stereoCapture->start();
+
+    // Frames are only picked up and repainted as often as the screen refreshes
     timer = new QTimer(this);
     connect(timer, SIGNAL(timeout()), this, SLOT(updateFrame()));
-    timer->start(10);
+    timer->start(displayRefreshInterval());
 
     stereoCalibDialog = NULL;
     dictDialog = NULL;
@@ -62,6 +69,10 @@ MainWindow::MainWindow(QWidget *parent) :
     calibrationThread = NULL;
     dictionaryThread = NULL;
     disparityThread = NULL;
+    depthWorker = NULL;
+    proximityThread = NULL;
+    disparityMode = DepthEngine::RoiBand;
+    depthMatcher = DepthEngine::SemiGlobal;
 
 }
 
@@ -69,62 +80,100 @@ MainWindow::~MainWindow()
 {
     if(categorizerThread != NULL)
     {
-        categorizerThread->quit();
+        categorizerThread->stop();
         categorizerThread->wait();
     }
 
     if(calibrationThread != NULL)
     {
-        calibrationThread->quit();
+        calibrationThread->stop();
         calibrationThread->wait();
     }
 
     if(dictionaryThread != NULL)
     {
-        dictionaryThread->quit();
+        dictionaryThread->stop();
         dictionaryThread->wait();
     }
 
     if(disparityThread != NULL)
     {
-        disparityThread->quit();
+        disparityThread->stop();
         disparityThread->wait();
     }
 
-    captureLeft.release();
-    captureRight.release();
+    if(depthWorker != NULL)
+    {
+        depthWorker->stop();
+        depthWorker->wait();
+    }
+
+    if(proximityThread != NULL)
+    {
+        proximityThread->stop();
+        proximityThread->wait();
+    }
+
+    stereoCapture->stop();
     delete ui;
 }
 
 
 void MainWindow::updateFrame()
 {
-    captureLeft.grab();
-    captureRight.grab();
+    TimestampedFrame left, right;
+    if(!stereoCapture->latestPair(left, right) || left.sequence == currentSequence)
+    {
+        return;
+    }
 
-    captureLeft.retrieve(currentFrameLeft);
-    captureRight.retrieve(currentFrameRight);
+    currentFrame = StereoFramePtr(new StereoFrame(left.frame, right.frame, calibration, left.timestamp, left.sequence));
+    currentSequence = left.sequence;
 
-    if(!currentFrameLeft.empty() && !currentFrameRight.empty())
+    if(!currentFrame->left().empty() && !currentFrame->right().empty())
     {
-        if(categorizerThread == NULL || (categorizerThread != NULL && categorizerThread->isFinished()))
-
+        // Several frame pairs are categorized at once, new ones are only dropped while the pipeline is full
+        if(categorizerThread == NULL || !categorizerThread->isBusy())
         {
             findObjects();
         }
 
+        // Every new frame pair goes to the depth worker, it keeps only the latest one. The sparse matcher
+        // needs the SURF keypoints, which only the pair the objects were found in carries, so it gets
+        // every categorized pair once instead.
+        if(depthWorker != NULL && !detectedObjects.isEmpty())
+        {
+            if(depthMatcher != DepthEngine::SparseKeypoints)
+            {
+                depthWorker->submit(currentFrame, detectedObjects);
+            }
+            else if(!detectionFrame.isNull() && detectionFrame->getSequence() != sparseDepthSequence)
+            {
+                depthWorker->submit(detectionFrame, detectedObjects);
+                sparseDepthSequence = detectionFrame->getSequence();
+            }
+        }
+
+        if(proximityThread != NULL && proximityThread->isRunning())
+        {
+            proximityThread->submit(currentFrame);
+        }
 
+        // Pooled frames are read-only, convert into the widget's back buffer and draw the detections there
         if(ui->tabWidget->currentIndex() == 0)
         {
-            showDetectedObjects(currentFrameLeft);
-            frameLeft = MatToQImage(currentFrameLeft);
-            ui->leftCameraLabel->setPixmap(QPixmap::fromImage(frameLeft).scaled(currentFrameLeft.cols, currentFrameLeft.rows, Qt::KeepAspectRatio));
+            cv::Mat display = ui->leftCameraLabel->frameBuffer(currentFrame->left().size());
+            bgrToRgb32(currentFrame->left(), display);
+            showDetectedObjects(display);
+            showObstacleGrid(display);
+            ui->leftCameraLabel->presentFrame();
         }
         else
         {
-            showDetectedObjects(currentFrameRight);
-            frameRight = MatToQImage(currentFrameRight);
-            ui->rightCameraLabel->setPixmap(QPixmap::fromImage(frameRight).scaled(currentFrameRight.cols, currentFrameRight.rows, Qt::KeepAspectRatio));
+            cv::Mat display = ui->rightCameraLabel->frameBuffer(currentFrame->right().size());
+            bgrToRgb32(currentFrame->right(), display);
+            showDetectedObjects(display);
+            ui->rightCameraLabel->presentFrame();
         }
    }
 
@@ -167,12 +216,41 @@ void MainWindow::showDetectedObjects(cv::Mat frame)
         cv::RNG rng(12345);
         for(iter = detectedObjects.begin(); iter != detectedObjects.end(); iter++)
         {
-            cv::Scalar color(rng.uniform(0,255), rng.uniform(0, 255), rng.uniform(0, 255));
+            cv::Scalar color(rng.uniform(0,255), rng.uniform(0, 255), rng.uniform(0, 255), 255);
             drawRectangle(frame, iter.value(), color, iter.key());
         }
     }
 }
 
+void MainWindow::showObstacleGrid(cv::Mat frame)
+{
+    if(proximityThread == NULL || !proximityThread->isRunning() || obstacleCells.empty())
+    {
+        return;
+    }
+
+    // Sectors of the left view with the distance to the nearest obstacle in each of them
+    for(int r = 0; r < obstacleCells.rows; r++)
+    {
+        for(int c = 0; c < obstacleCells.cols; c++)
+        {
+            cv::Rect cell(c * frame.cols / obstacleCells.cols, r * frame.rows / obstacleCells.rows,
+                          frame.cols / obstacleCells.cols, frame.rows / obstacleCells.rows);
+            cv::rectangle(frame, cell, cv::Scalar(255, 255, 255, 255), 1);
+
+            float depth = obstacleCells.at<float>(r, c);
+            if(depth > 0.f)
+            {
+                // Red below half a metre, yellow below one and a half, green beyond
+                cv::Scalar color = depth < 500.f ? cv::Scalar(0, 0, 255, 255) :
+                                   depth < 1500.f ? cv::Scalar(0, 255, 255, 255) : cv::Scalar(0, 255, 0, 255);
+                cv::putText(frame, QString::number(depth / 10.0, 'f', 0).toStdString() + " cm",
+                            cell.tl() + cv::Point(5, 20), cv::FONT_HERSHEY_SIMPLEX, 0.6, color, 2);
+            }
+        }
+    }
+}
+
 void MainWindow::findObjects()
 {
     if(templates.isEmpty() || categoryNames.isEmpty() ||
@@ -182,37 +260,41 @@ void MainWindow::findObjects()
     }
     else
     {
-        if(detectedObjects.size() > 0)
-        {
-            detectedObjects.clear();
-        }
-		
+        // Detections stay on screen until the next frame pair in order replaces them
         if(categorizerThread == NULL)
         {
-            categorizerThread = new CategorizerThread(currentFrameLeft, svms, vocab,
-                                                      keypoints, desc, templates, categoryNames);
+            // One frame pair per worker but the one kept free of background work, as long as the camera pools
+            // can lease them. Outside the rings, currentFrame, detectionFrame, the depth worker and proximity
+            // thread (pending and processing each) and the disparity task hold up to 7 leases per camera
+            const int reservedLeases = 7;
+            int framesInFlight = std::min(TaskScheduler::instance()->workerCount() - 1,
+                                          stereoCapture->getSpareLeases() - reservedLeases);
+            categorizerThread = new CategorizerThread(svms, vocab, keypoints, desc, templates, categoryNames,
+                                                      std::max(1, framesInFlight));
 
             qRegisterMetaType<QMap<QString, std::vector<cv::Point2f> > >("QMap<QString, std::vector<cv::Point2f> >");
+            qRegisterMetaType<StereoFramePtr>("StereoFramePtr");
 
-            connect(categorizerThread, SIGNAL(doneProcessing(QMap<QString, std::vector<cv::Point2f> >)),
-                  this, SLOT(objectRecognition(QMap<QString, std::vector<cv::Point2f> >)));
+            connect(categorizerThread, SIGNAL(doneProcessing(QMap<QString, std::vector<cv::Point2f> >,StereoFramePtr)),
+                  this, SLOT(objectRecognition(QMap<QString, std::vector<cv::Point2f> >,StereoFramePtr)));
             connect(categorizerThread, SIGNAL(sendException(QString,int)), this, SLOT(setMessage(QString, int)));
         }
-        else
-        {
-            categorizerThread->setFrame(currentFrameLeft);
-        }
 
-        categorizerThread -> start();
+        categorizerThread->submit(currentFrame);
 
 
     }
 }
 
-void MainWindow::objectRecognition(const QMap<QString, std::vector<cv::Point2f> > &detectedObjects)
+void MainWindow::objectRecognition(const QMap<QString, std::vector<cv::Point2f> > &detectedObjects,
+                                   const StereoFramePtr &frame)
 {
 
     this->detectedObjects = detectedObjects;
+    detectionFrame = frame;
+
+    //Capture-to-result latency of the frame pair that was just categorized
+    latencyLabel->setText("Latency: " + QString::number(captureTimestamp() - frame->getTimestamp(), 'f', 0) + " ms");
 
     if(!detectedObjects.isEmpty())
     {
@@ -273,20 +355,44 @@ void MainWindow::setMessage(const QString &message, int timeout)
     ui->statusBar->showMessage(message, timeout);
 }
 
-void MainWindow::setObjectDistance(const cv::Scalar &distance, const QString &category)
+void MainWindow::setObjectDistance(const cv::Scalar &distance, const QString &category, double timestamp)
 {
-    QString objectDistance = category + ": " + QString::number(distance[0]/10.0) + " cm";
-    ui->distanceLine->setText(objectDistance);
+    // Successive measurements of the object are fused into its track
+    distanceTracks.update(category, timestamp, DepthStatistics::fromScalar(distance));
+    distanceTracks.removeStale(timestamp);
+
+    float filtered, velocity, sigma;
+    if(distanceTracks.predict(category, timestamp, filtered, velocity, sigma))
+    {
+        QString objectDistance = category + ": " + QString::number(filtered/10.0, 'f', 1) + " cm (+-" +
+                                 QString::number(sigma/10.0, 'f', 1) + ")";
+        ui->distanceLine->setText(objectDistance);
+    }
 
 }
 
-void MainWindow::setRectificationData(const cv::Mat &map_l1, const cv::Mat &map_l2, const cv::Mat &map_r1, const cv::Mat &map_r2, const cv::Mat &Q)
+void MainWindow::setObjectDistances(const QMap<QString, cv::Scalar> &distances)
 {
-    this->map_l1 = map_l1;
-    this->map_l2 = map_l2;
-    this->map_r1 = map_r1;
-    this->map_r2 = map_r2;
-    this->Q = Q;
+    QStringList objectDistances;
+    QMap<QString, cv::Scalar>::const_iterator iter;
+    for(iter = distances.begin(); iter != distances.end(); iter++)
+    {
+        // Filtered distance and its uncertainty, predicted when the object was not measured on this pair
+        objectDistances << iter.key() + ": " + QString::number(iter.value()[0]/10.0, 'f', 1) + " cm (+-" +
+                           QString::number(iter.value()[2]/10.0, 'f', 1) + ")";
+    }
+    ui->distanceLine->setText(objectDistances.join(", "));
+}
+
+void MainWindow::setObstacleGrid(const cv::Mat &grid, double latency)
+{
+    obstacleCells = grid;
+    latencyLabel->setToolTip("Obstacle grid: " + QString::number(latency, 'f', 1) + " ms");
+}
+
+void MainWindow::setRectificationData(const StereoCalibration &calibration)
+{
+    this->calibration = calibration;
 }
 
 void MainWindow::drawRectangle(cv::Mat img,
@@ -309,35 +415,41 @@ void MainWindow::drawRectangle(cv::Mat img,
 
 void MainWindow::on_distanceButton_clicked()
 {
-    if(map_l1.empty() || map_l2.empty() || map_r1.empty() || map_r2.empty() || Q.empty())
+    if(!calibration.isValid())
     {
         QMessageBox::critical(this, "No Calibration Data Found", "No calibration data found. Try loading from file, if available(File->Load Calibration Data) or calibrating your stereo camera(File->Camera Calibration)");
     }
     else
     {
        int row = getCheckedItem();
-       if(!detectedObjects.empty() && row != -1)
+       bool busy = disparityThread != NULL && disparityThread->isRunning();
+       if(!detectedObjects.empty() && row != -1 && !busy)
        {     
           QString object = ui->objectList->item(row)->text();
 
-          if(disparityThread != NULL)
+          // The sparse matcher reuses the keypoints of the pair the object was found in
+          StereoFramePtr frame = currentFrame;
+          if(depthMatcher == DepthEngine::SparseKeypoints && !detectionFrame.isNull())
           {
-              disparityThread = new DisparityThread(currentFrameLeft, currentFrameRight, map_l1, map_l2,
-                                                    map_r1, map_r2, Q, currentFrameLeft.size(),
-                                                    detectedObjects[object], object);
+              frame = detectionFrame;
+          }
+
+          if(disparityThread == NULL)
+          {
+              disparityThread = new DisparityThread(frame, detectedObjects[object], object);
               qRegisterMetaType<cv::Scalar>("cv::Scalar");
-              connect(disparityThread, SIGNAL(objectDistance(cv::Scalar, QString)), this, SLOT(setObjectDistance(cv::Scalar, QString)));
+              connect(disparityThread, SIGNAL(objectDistance(cv::Scalar, QString, double)), this, SLOT(setObjectDistance(cv::Scalar, QString, double)));
               connect(disparityThread, SIGNAL(sendMessage(QString,int)), this, SLOT(setMessage(QString,int)));
           }
           else
           {
-              disparityThread->setFramel(currentFrameLeft);
-              disparityThread->setFramer(currentFrameRight);
-              disparityThread->setImageSize(currentFrameLeft.size());
+              disparityThread->setFrame(frame);
               disparityThread->setDetectedObject(detectedObjects[object]);
               disparityThread->setCategory(object);
           }
 
+          disparityThread->setMode(disparityMode);
+          disparityThread->setMatcher(depthMatcher);
           disparityThread->start();
 
        }
@@ -378,11 +490,13 @@ void MainWindow::on_actionAdd_object_triggered()
     dictDialog = new DictionaryDialog(this, leftCamera, svmDataDirectory);
 
     timer -> stop();
+    stereoCapture -> stop();
     dictDialog -> show();
 
     int mode = dictDialog -> exec();
     if(mode == QDialog::Rejected)
     {
+        stereoCapture -> start();
         timer -> start();
     }
     if(mode == QDialog::Accepted)
@@ -397,6 +511,7 @@ void MainWindow::on_actionAdd_object_triggered()
         generateKpDesc(dictDialog -> getObjectTemplate(), kp, descriptor);
         keypoints[dictDialog -> getObjectName()] = kp;
         desc[dictDialog -> getObjectName()] = descriptor;
+        stereoCapture -> start();
         timer -> start();
 		
         if(dictionaryThread == NULL)
@@ -426,6 +541,7 @@ void MainWindow::on_actionAdd_object_triggered()
 void MainWindow::on_actionCamera_Calibration_triggered()
 {
     timer->stop();
+    stereoCapture->stop();
 
     if(stereoCalibDialog != NULL)
         delete stereoCalibDialog;
@@ -441,6 +557,7 @@ void MainWindow::on_actionCamera_Calibration_triggered()
 
     if(mode == QDialog::Rejected)
     {
+        stereoCapture->start();
         timer->start();
     }
     if(mode == QDialog::Accepted)
@@ -448,6 +565,7 @@ void MainWindow::on_actionCamera_Calibration_triggered()
         cv::Size patternSize = stereoCalibDialog->getPatternSize();
         float sideLength = stereoCalibDialog->getSquareSize();
 
+        stereoCapture->start();
         timer->start();
 		
         if(calibrationThread == NULL)
@@ -456,9 +574,9 @@ void MainWindow::on_actionCamera_Calibration_triggered()
 
             connect(calibrationThread, SIGNAL(updateProgress(int)), this, SLOT(setProgress(int)));
             connect(calibrationThread, SIGNAL(sendMessage(QString)), ui->statusBar, SLOT(showMessage(QString)));
-            qRegisterMetaType<cv::Mat>("cv::Mat");
-            connect(calibrationThread, SIGNAL(sendRectificationData(cv::Mat,cv::Mat,cv::Mat,cv::Mat,cv::Mat)),
-                    this, SLOT(setRectificationData(cv::Mat,cv::Mat,cv::Mat,cv::Mat,cv::Mat)));
+            qRegisterMetaType<StereoCalibration>("StereoCalibration");
+            connect(calibrationThread, SIGNAL(sendRectificationData(StereoCalibration)),
+                    this, SLOT(setRectificationData(StereoCalibration)));
         }
 
         progressBar->show();
@@ -481,15 +599,7 @@ void MainWindow::on_actionLoad_Calibration_Data_triggered()
     timer->start();
     if(!calibDataFile.isEmpty())
     {
-        cv::FileStorage fs(calibDataFile.toStdString(), cv::FileStorage::READ);
-        fs["Q"] >> Q;
-        fs["map_l1"] >> map_l1;
-        fs["map_l2"] >> map_l2;
-        fs["map_r1"] >> map_r1;
-        fs["map_r2"] >> map_r2;
-        fs.release();
-
-        if(!map_l1.empty() && !map_l2.empty() && !map_r1.empty() && !map_r2.empty() && !Q.empty())
+        if(calibration.load(calibDataFile))
         {
             QMessageBox::information(this, "Calibration data", "Calibration data loaded successfully.");
         }
@@ -497,6 +607,128 @@ void MainWindow::on_actionLoad_Calibration_Data_triggered()
 
 }
 
+void MainWindow::on_actionMatch_Object_Band_Only_toggled(bool checked)
+{
+    disparityMode = checked ? DepthEngine::RoiBand : DepthEngine::FullFrame;
+
+    if(depthWorker != NULL)
+    {
+        depthWorker->setMode(disparityMode);
+    }
+}
+
+void MainWindow::on_actionContinuous_Distance_toggled(bool checked)
+{
+    if(checked)
+    {
+        if(!calibration.isValid())
+        {
+            QMessageBox::critical(this, "No Calibration Data Found", "No calibration data found. Try loading from file, if available(File->Load Calibration Data) or calibrating your stereo camera(File->Camera Calibration)");
+            ui->actionContinuous_Distance->setChecked(false);
+            return;
+        }
+
+        if(depthWorker == NULL)
+        {
+            depthWorker = new DepthWorker();
+            qRegisterMetaType<QMap<QString, cv::Scalar> >("QMap<QString, cv::Scalar>");
+            connect(depthWorker, SIGNAL(objectDistances(QMap<QString, cv::Scalar>)), this, SLOT(setObjectDistances(QMap<QString, cv::Scalar>)));
+            connect(depthWorker, SIGNAL(sendMessage(QString,int)), this, SLOT(setMessage(QString,int)));
+        }
+
+        depthWorker->setMode(disparityMode);
+        depthWorker->setMatcher(depthMatcher);
+        depthWorker->start();
+        ui->distanceButton->setVisible(false);
+    }
+    else if(depthWorker != NULL)
+    {
+        depthWorker->stop();
+        depthWorker->wait();
+        ui->distanceButton->setVisible(true);
+        ui->distanceLine->clear();
+    }
+}
+
+void MainWindow::setDepthMatcher(DepthEngine::Matcher matcher)
+{
+    depthMatcher = matcher;
+
+    if(depthWorker != NULL)
+    {
+        depthWorker->setMatcher(depthMatcher);
+    }
+}
+
+void MainWindow::on_actionObstacle_Proximity_toggled(bool checked)
+{
+    if(checked)
+    {
+        if(!calibration.isValid())
+        {
+            QMessageBox::critical(this, "No Calibration Data Found", "No calibration data found. Try loading from file, if available(File->Load Calibration Data) or calibrating your stereo camera(File->Camera Calibration)");
+            ui->actionObstacle_Proximity->setChecked(false);
+            return;
+        }
+
+        if(proximityThread == NULL)
+        {
+            proximityThread = new ProximityThread();
+            qRegisterMetaType<cv::Mat>("cv::Mat");
+            connect(proximityThread, SIGNAL(obstacleGrid(cv::Mat,double)), this, SLOT(setObstacleGrid(cv::Mat,double)));
+            connect(proximityThread, SIGNAL(sendMessage(QString,int)), this, SLOT(setMessage(QString,int)));
+        }
+
+        proximityThread->start();
+    }
+    else if(proximityThread != NULL)
+    {
+        proximityThread->stop();
+        proximityThread->wait();
+        obstacleCells.release();
+    }
+}
+
+void MainWindow::on_actionSemi_Global_Matching_toggled(bool checked)
+{
+    if(checked)
+    {
+        setDepthMatcher(DepthEngine::SemiGlobal);
+    }
+}
+
+void MainWindow::on_actionSparse_Keypoint_Matching_toggled(bool checked)
+{
+    if(checked)
+    {
+        setDepthMatcher(DepthEngine::SparseKeypoints);
+    }
+}
+
+void MainWindow::on_actionCoarse_to_Fine_Matching_toggled(bool checked)
+{
+    if(checked)
+    {
+        setDepthMatcher(DepthEngine::CoarseToFine);
+    }
+}
+
+void MainWindow::on_actionBlock_Matching_toggled(bool checked)
+{
+    if(checked)
+    {
+        setDepthMatcher(DepthEngine::BlockMatching);
+    }
+}
+
+void MainWindow::on_actionAutomatic_Matcher_toggled(bool checked)
+{
+    if(checked)
+    {
+        setDepthMatcher(DepthEngine::Automatic);
+    }
+}
+
 void MainWindow::on_actionHelp_triggered()
 {
     QFileInfo helpFile("data/help.pdf");
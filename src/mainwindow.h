@@ -16,6 +16,8 @@
 #include <QDesktopWidget>
 #include <QUrl>
 #include <QStyle>
+#include <QLabel>
+#include <QActionGroup>
 
 #include <string>
 
@@ -34,7 +36,14 @@
 #include "stereocalibrationdialog.h"
 #include "calibrationthread.h"
 #include "disparitythread.h"
+#include "depthworker.h"
+#include "distancetracker.h"
+#include "proximitythread.h"
 #include "stereocameradialog.h"
+#include "stereocalibration.h"
+#include "stereocapture.h"
+#include "stereoframe.h"
+#include "framewidget.h"
 
 namespace Ui {
 class MainWindow;
@@ -56,13 +65,12 @@ private:
     int leftCamera;
     int rightCamera;
 
-    cv::Mat currentFrameLeft;
-    cv::Mat currentFrameRight;
-    QImage frameLeft;
-    QImage frameRight;
+    StereoFramePtr currentFrame; //current frame pair and its derived images, shared with the worker threads
+    qint64 currentSequence; //sequence number of the current left frame
+    StereoFramePtr detectionFrame; //frame pair detectedObjects were found in, carries its SURF keypoints
+    qint64 sparseDepthSequence; //detection frame pair last sent to the depth worker for sparse matching
     QTimer *timer;
-    cv::VideoCapture captureLeft;
-    cv::VideoCapture captureRight;
+    StereoCapture *stereoCapture;
 
     QMap<QString, std::vector<cv::Point2f> > detectedObjects;
     QMap<QString, cv::Mat> templates;
@@ -80,17 +88,22 @@ private:
     DictionaryThread *dictionaryThread;
     CalibrationThread *calibrationThread;
     DisparityThread *disparityThread;
+    DepthWorker *depthWorker; //streams distances of all detected objects while continuous distance is on
+    ProximityThread *proximityThread; //nearest obstacle per sector while obstacle proximity is on
+    cv::Mat obstacleCells; //latest obstacle grid, see ObstacleGrid::compute()
+    DepthEngine::Mode disparityMode;
+    DepthEngine::Matcher depthMatcher;
 
     DictionaryDialog *dictDialog;
     StereoCalibrationDialog *stereoCalibDialog;
     StereoCameraDialog *stereoCameraDialog;
 
     QProgressBar *progressBar;
+    QLabel *latencyLabel;
 
     /* Needed to calculate distance(disparity) */
-    cv::Mat map_l1, map_l2;
-    cv::Mat map_r1, map_r2;
-    cv::Mat Q;
+    StereoCalibration calibration;
+    DistanceTracker distanceTracks; //filtered distances of the one-shot measurements
 
     void findObjects();
     void drawRectangle(cv::Mat img, std::vector<cv::Point2f> corners, cv::Scalar color, QString category); //draw rectangle around detected object
@@ -99,17 +112,20 @@ private:
     void populateList();
     int getCheckedItem();
     void showDetectedObjects(cv::Mat frame);
+    void setDepthMatcher(DepthEngine::Matcher matcher);
+    void showObstacleGrid(cv::Mat frame);
 
 private slots:
 
     void updateFrame();
-    void objectRecognition(const QMap<QString, std::vector<cv::Point2f> > &detectedObjects);
+    void objectRecognition(const QMap<QString, std::vector<cv::Point2f> > &detectedObjects, const StereoFramePtr &frame);
     void setProgress(int progress);
     void setDictSVM(const QMap<QString, cv::SVM> &svms, const cv::Mat &vocab);
     void setMessage(const QString &message, int timeout = 0);
-    void setObjectDistance(const cv::Scalar &distance, const QString &category);
-    void setRectificationData(const cv::Mat &map_l1, const cv::Mat &map_l2, const cv::Mat &map_r1,
-                              const cv::Mat &map_r2, const cv::Mat &Q);
+    void setObjectDistance(const cv::Scalar &distance, const QString &category, double timestamp);
+    void setObjectDistances(const QMap<QString, cv::Scalar> &distances);
+    void setObstacleGrid(const cv::Mat &grid, double latency);
+    void setRectificationData(const StereoCalibration &calibration);
     void on_actionLoad_Dictionary_triggered();
     void on_actionGenerate_Template_Keypoints_triggered();
     void on_distanceButton_clicked();
@@ -117,6 +133,14 @@ private slots:
     void on_actionCamera_Calibration_triggered();
     void on_actionExit_triggered();
     void on_actionLoad_Calibration_Data_triggered();
+    void on_actionMatch_Object_Band_Only_toggled(bool checked);
+    void on_actionContinuous_Distance_toggled(bool checked);
+    void on_actionObstacle_Proximity_toggled(bool checked);
+    void on_actionSemi_Global_Matching_toggled(bool checked);
+    void on_actionSparse_Keypoint_Matching_toggled(bool checked);
+    void on_actionCoarse_to_Fine_Matching_toggled(bool checked);
+    void on_actionBlock_Matching_toggled(bool checked);
+    void on_actionAutomatic_Matcher_toggled(bool checked);
     void on_actionHelp_triggered();
 };
 
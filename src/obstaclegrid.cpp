@@ -0,0 +1,166 @@
+#include "obstaclegrid.h"
+#include "utilities.h"
+
+#include <algorithm>
+#include <vector>
+
+// Camera and projection matrices of the same camera at 1/scale of the size
+static cv::Mat scaledProjection(const cv::Mat &matrix, double scale)
+{
+    cv::Mat scaled;
+    matrix.convertTo(scaled, CV_64F);
+    scaled.rowRange(0, 2) *= 1.0 / scale;
+    return scaled;
+}
+
+ObstacleGrid::ObstacleGrid(int rows, int cols)
+{
+    setRows(rows);
+    setCols(cols);
+    levels = 2;
+    percentile = 0.1f;
+    mapLevels = -1;
+
+    initWebcamBlockMatcher(stereo, 9);
+    stereo.state->speckleWindowSize = 0;
+}
+
+int ObstacleGrid::getRows() const
+{
+    return rows;
+}
+
+void ObstacleGrid::setRows(int value)
+{
+    rows = std::max(value, 1);
+}
+
+int ObstacleGrid::getCols() const
+{
+    return cols;
+}
+
+void ObstacleGrid::setCols(int value)
+{
+    cols = std::max(value, 1);
+}
+
+int ObstacleGrid::getLevels() const
+{
+    return levels;
+}
+
+void ObstacleGrid::setLevels(int value)
+{
+    levels = std::min(std::max(value, 0), 3);
+}
+
+float ObstacleGrid::getPercentile() const
+{
+    return percentile;
+}
+
+void ObstacleGrid::setPercentile(float value)
+{
+    percentile = std::min(std::max(value, 0.f), 1.f);
+}
+
+cv::Mat ObstacleGrid::compute(const StereoFrame &frame)
+{
+    cv::Mat grid = cv::Mat::zeros(rows, cols, CV_32FC1);
+
+    const StereoCalibration &calibration = frame.getCalibration();
+    if(frame.left().empty() || frame.right().empty() || calibration.Q.empty() ||
+       calibration.cameraMatrixLeft.empty() || calibration.Pl.empty())
+    {
+        return grid;
+    }
+
+    cv::Mat_<double> q;
+    calibration.Q.convertTo(q, CV_64F);
+    if(mapLevels != levels || mapQ.empty() || cv::norm(mapQ, q, cv::NORM_INF) > 0.0)
+    {
+        initMaps(calibration);
+    }
+
+    // The left pyramid is shared with the other consumers of the pair
+    cv::Mat smallRight = frame.grayRight();
+    for(int i = 0; i < levels; i++)
+    {
+        cv::pyrDown(smallRight, smallRight);
+    }
+
+    cv::Mat rectLeft, rectRight;
+    cv::remap(frame.pyramidLeft(levels), rectLeft, mapLeft1, mapLeft2, cv::INTER_LINEAR);
+    cv::remap(smallRight, rectRight, mapRight1, mapRight2, cv::INTER_LINEAR);
+
+    // The search range of the full size pair, reduced with the image
+    int scale = 1 << levels;
+    stereo.state->minDisparity = 16 / scale;
+    stereo.state->numberOfDisparities = std::max(16, ((112 / scale - stereo.state->minDisparity) + 15) / 16 * 16);
+
+    cv::Mat disp;
+    stereo(rectLeft, rectRight, disp, CV_16S);
+
+    // Z = q23 / (q32 * d + q33) with d in full size pixels
+    const float q23 = (float)q(2, 3);
+    const float q32 = (float)q(3, 2) * scale / 16.f;
+    const float q33 = (float)q(3, 3);
+    const short invalid = (short)((stereo.state->minDisparity - 1) * 16);
+
+    std::vector<float> depths;
+    for(int r = 0; r < rows; r++)
+    {
+        int y0 = r * disp.rows / rows, y1 = (r + 1) * disp.rows / rows;
+        for(int c = 0; c < cols; c++)
+        {
+            int x0 = c * disp.cols / cols, x1 = (c + 1) * disp.cols / cols;
+
+            depths.clear();
+            for(int y = y0; y < y1; y++)
+            {
+                const short *d = disp.ptr<short>(y);
+                for(int x = x0; x < x1; x++)
+                {
+                    if(d[x] > invalid)
+                    {
+                        float w = d[x] * q32 + q33;
+                        if(w > 0.f)
+                        {
+                            depths.push_back(q23 / w);
+                        }
+                    }
+                }
+            }
+
+            // A few stray matches are not an obstacle
+            if((int)depths.size() < (x1 - x0) * (y1 - y0) / 20 || depths.empty())
+            {
+                continue;
+            }
+
+            std::vector<float>::iterator nth = depths.begin() + (int)(percentile * (depths.size() - 1));
+            std::nth_element(depths.begin(), nth, depths.end());
+            grid.at<float>(r, c) = *nth;
+        }
+    }
+
+    return grid;
+}
+
+void ObstacleGrid::initMaps(const StereoCalibration &calibration)
+{
+    double scale = 1 << levels;
+    cv::Size size(calibration.imageSize.width >> levels, calibration.imageSize.height >> levels);
+
+    // pyrDown rounds up, the remapped pair has exactly the reduced size
+    cv::initUndistortRectifyMap(scaledProjection(calibration.cameraMatrixLeft, scale), calibration.distCoeffsLeft,
+                                calibration.Rl, scaledProjection(calibration.Pl, scale), size, CV_16SC2,
+                                mapLeft1, mapLeft2);
+    cv::initUndistortRectifyMap(scaledProjection(calibration.cameraMatrixRight, scale), calibration.distCoeffsRight,
+                                calibration.Rr, scaledProjection(calibration.Pr, scale), size, CV_16SC2,
+                                mapRight1, mapRight2);
+
+    calibration.Q.convertTo(mapQ, CV_64F);
+    mapLevels = levels;
+}
@@ -0,0 +1,52 @@
+#ifndef OBSTACLEGRID_H
+#define OBSTACLEGRID_H
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+//Local
+#include "stereoframe.h"
+
+/* Nearest obstacle per image sector from a heavily downsampled disparity map.
+ * The grayscale pair is reduced with a pyramid and rectified with maps built for the reduced size,
+ * StereoBM matches the small pair and every cell of a coarse grid reports a near percentile of the
+ * depths inside it, so nearby unrecognized objects are reported as well. */
+class ObstacleGrid
+{
+public:
+
+    ObstacleGrid(int rows = 3, int cols = 5);
+
+    cv::Mat compute(const StereoFrame &frame); //CV_32FC1 rows x cols, depth in mm, 0 where nothing was matched
+
+    int getRows() const;
+    void setRows(int value);
+
+    int getCols() const;
+    void setCols(int value);
+
+    int getLevels() const;
+    void setLevels(int value); //pyramid levels, 2 matches a quarter size pair
+
+    float getPercentile() const;
+    void setPercentile(float value); //0 reports the nearest pixel, 0.5 the median
+
+private:
+
+    int rows, cols;
+    int levels;
+    float percentile;
+
+    cv::StereoBM stereo;
+
+    // Rectification maps of the reduced pair, rebuilt when the calibration changes
+    cv::Mat mapLeft1, mapLeft2, mapRight1, mapRight2;
+    cv::Mat mapQ; //Q the maps were built for
+    int mapLevels;
+
+    void initMaps(const StereoCalibration &calibration);
+
+};
+
+#endif // OBSTACLEGRID_H
@@ -0,0 +1,277 @@
+#include "onlinecalibrationthread.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Intrinsics are only estimated once this many views are available
+static const int minSolveViews = 3;
+
+/* Standard deviation of fx, fy, cx and cy from the Jacobian of the reprojection of all views.
+ * The covariance of all parameters (intrinsics, distortion and the pose of every view) is
+ * sigma^2 (J^T J)^-1, sigma^2 being the per-coordinate reprojection variance. */
+static cv::Vec4d intrinsicStdDev(const std::vector<std::vector<cv::Point3f> > &objectPoints,
+                                 const std::vector<std::vector<cv::Point2f> > &imagePoints,
+                                 const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs,
+                                 const std::vector<cv::Mat> &rvecs, const std::vector<cv::Mat> &tvecs, double rms)
+{
+    int views = objectPoints.size();
+    int distortion = distCoeffs.total();
+    int intrinsics = 4 + distortion;
+    int params = intrinsics + 6 * views;
+
+    cv::Mat JtJ = cv::Mat::zeros(params, params, CV_64F);
+    for(int v = 0; v < views; v++)
+    {
+        std::vector<cv::Point2f> projected;
+        cv::Mat jacobian; //columns: rvec(3), tvec(3), f(2), c(2), distortion
+        cv::projectPoints(objectPoints[v], rvecs[v], tvecs[v], cameraMatrix, distCoeffs, projected, jacobian);
+
+        cv::Mat J = cv::Mat::zeros(jacobian.rows, params, CV_64F);
+        jacobian.colRange(6, 10).copyTo(J.colRange(0, 4));
+        jacobian.colRange(10, 10 + distortion).copyTo(J.colRange(4, intrinsics));
+        jacobian.colRange(0, 6).copyTo(J.colRange(intrinsics + 6 * v, intrinsics + 6 * v + 6));
+
+        cv::Mat viewJtJ;
+        cv::mulTransposed(J, viewJtJ, true);
+        JtJ += viewJtJ;
+    }
+
+    cv::Mat covariance;
+    cv::invert(JtJ, covariance, cv::DECOMP_SVD);
+    covariance *= rms * rms / 2.0;
+
+    cv::Vec4d deviation;
+    for(int i = 0; i < 4; i++)
+    {
+        deviation[i] = std::sqrt(std::max(covariance.at<double>(i, i), 0.0));
+    }
+    return deviation;
+}
+
+OnlineCalibrationThread::OnlineCalibrationThread(cv::Size patternSize, float sideLength) :
+    StreamingTask(Task::Background)
+{
+    this->patternSize = patternSize;
+    this->sideLength = sideLength;
+    imageSize = cv::Size(0, 0);
+
+    maxUncertainty = 1.5;
+    minViews = 8;
+    minPoseDistance = 0.1;
+    hasConverged = false;
+}
+
+void OnlineCalibrationThread::submit(int view, const cv::Mat &grayLeft, const cv::Mat &grayRight)
+{
+    QMutexLocker locker(&inputMutex);
+
+    PendingView pendingView;
+    pendingView.view = view;
+    pendingView.grayLeft = grayLeft;
+    pendingView.grayRight = grayRight;
+    pending.enqueue(pendingView);
+    schedule();
+}
+
+double OnlineCalibrationThread::getMaxUncertainty() const
+{
+    QMutexLocker locker(&inputMutex);
+    return maxUncertainty;
+}
+
+void OnlineCalibrationThread::setMaxUncertainty(double value)
+{
+    QMutexLocker locker(&inputMutex);
+    maxUncertainty = value;
+}
+
+int OnlineCalibrationThread::getMinViews() const
+{
+    QMutexLocker locker(&inputMutex);
+    return minViews;
+}
+
+void OnlineCalibrationThread::setMinViews(int value)
+{
+    QMutexLocker locker(&inputMutex);
+    minViews = std::max(value, minSolveViews);
+}
+
+double OnlineCalibrationThread::getMinPoseDistance() const
+{
+    QMutexLocker locker(&inputMutex);
+    return minPoseDistance;
+}
+
+void OnlineCalibrationThread::setMinPoseDistance(double value)
+{
+    QMutexLocker locker(&inputMutex);
+    minPoseDistance = value;
+}
+
+bool OnlineCalibrationThread::hasPending() const
+{
+    return !pending.isEmpty();
+}
+
+void OnlineCalibrationThread::takePending()
+{
+    current = pending.dequeue();
+}
+
+void OnlineCalibrationThread::clearPending()
+{
+    pending.clear();
+}
+
+void OnlineCalibrationThread::process()
+{
+    try
+    {
+        processView(current);
+    }
+    catch(const cv::Exception& e)
+    {
+        emit viewRejected(current.view, QString::fromStdString(e.err));
+    }
+    catch(...)
+    {
+        emit viewRejected(current.view, "calibration failed");
+    }
+
+    current.grayLeft.release();
+    current.grayRight.release();
+}
+
+void OnlineCalibrationThread::processView(const PendingView &view)
+{
+    std::vector<cv::Point2f> cornersLeft, cornersRight;
+    if(!findChessboard(view.grayLeft, patternSize, cornersLeft) ||
+       !findChessboard(view.grayRight, patternSize, cornersRight))
+    {
+        emit viewRejected(view.view, "chessboard not found in both images");
+        return;
+    }
+    imageSize = view.grayLeft.size();
+
+    // A view too close to an accepted one adds no pose coverage
+    cv::Vec<double, 5> pose = poseDescriptor(cornersLeft);
+    for(size_t i = 0; i < poses.size(); i++)
+    {
+        if(cv::norm(pose - poses[i]) < getMinPoseDistance())
+        {
+            emit viewRejected(view.view, "no new board position, size or tilt");
+            return;
+        }
+    }
+
+    std::vector<cv::Point3f> objPoints;
+    for(int i = 0; i < patternSize.height; i++)
+    {
+        for(int j = 0; j < patternSize.width; j++)
+        {
+            objPoints.push_back(cv::Point3f(j * sideLength, i * sideLength, 0.f));
+        }
+    }
+
+    poses.push_back(pose);
+    objectPoints.push_back(objPoints);
+    imagePointsLeft.push_back(cornersLeft);
+    imagePointsRight.push_back(cornersRight);
+
+    int views = objectPoints.size();
+    if(views < minSolveViews)
+    {
+        emit viewAccepted(view.view, views, 0.0, 0.0);
+        return;
+    }
+
+    // Solved into copies, a view whose solve fails is rejected and leaves no trace in the estimate
+    cv::Mat newCameraMatrixLeft = cameraMatrixLeft.clone(), newCameraMatrixRight = cameraMatrixRight.clone();
+    cv::Mat newDistCoeffsLeft = distCoeffsLeft.clone(), newDistCoeffsRight = distCoeffsRight.clone();
+    cv::Mat newR, newT, newE, newF;
+    double uncertaintyLeft, uncertaintyRight, rms;
+    try
+    {
+        // Intrinsics of both cameras, then the extrinsics with the intrinsics held fixed
+        calibrateCamera(imagePointsLeft, newCameraMatrixLeft, newDistCoeffsLeft, uncertaintyLeft);
+        calibrateCamera(imagePointsRight, newCameraMatrixRight, newDistCoeffsRight, uncertaintyRight);
+
+        rms = cv::stereoCalibrate(objectPoints, imagePointsLeft, imagePointsRight,
+                                  newCameraMatrixLeft, newDistCoeffsLeft, newCameraMatrixRight, newDistCoeffsRight,
+                                  imageSize, newR, newT, newE, newF,
+                                  cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, 1e-6),
+                                  cv::CALIB_FIX_INTRINSIC);
+    }
+    catch(...)
+    {
+        poses.pop_back();
+        objectPoints.pop_back();
+        imagePointsLeft.pop_back();
+        imagePointsRight.pop_back();
+        throw;
+    }
+
+    cameraMatrixLeft = newCameraMatrixLeft;
+    cameraMatrixRight = newCameraMatrixRight;
+    distCoeffsLeft = newDistCoeffsLeft;
+    distCoeffsRight = newDistCoeffsRight;
+    R = newR;
+    T = newT;
+    E = newE;
+    F = newF;
+
+    double uncertainty = std::max(uncertaintyLeft, uncertaintyRight);
+    emit viewAccepted(view.view, views, rms, uncertainty);
+
+    // Reported once, views captured afterwards still refine the estimate
+    if(!hasConverged && views >= getMinViews() && uncertainty <= getMaxUncertainty())
+    {
+        hasConverged = true;
+        emit converged(views, rms, uncertainty);
+    }
+}
+
+cv::Vec<double, 5> OnlineCalibrationThread::poseDescriptor(const std::vector<cv::Point2f> &corners) const
+{
+    // Outer corners of the board
+    cv::Point2f c0 = corners[0];
+    cv::Point2f c1 = corners[patternSize.width - 1];
+    cv::Point2f c2 = corners[corners.size() - 1];
+    cv::Point2f c3 = corners[corners.size() - patternSize.width];
+
+    double top = cv::norm(c1 - c0), bottom = cv::norm(c2 - c3);
+    double left = cv::norm(c3 - c0), right = cv::norm(c2 - c1);
+
+    std::vector<cv::Point2f> quad;
+    quad.push_back(c0);
+    quad.push_back(c1);
+    quad.push_back(c2);
+    quad.push_back(c3);
+    double area = std::fabs(cv::contourArea(quad));
+
+    // Position and size relative to the image, tilt from the foreshortening of opposite edges
+    cv::Point2f center = (c0 + c1 + c2 + c3) * 0.25f;
+    cv::Vec<double, 5> pose;
+    pose[0] = center.x / imageSize.width;
+    pose[1] = center.y / imageSize.height;
+    pose[2] = std::sqrt(area / imageSize.area());
+    pose[3] = 2.0 * (top - bottom) / std::max(top + bottom, 1.0);
+    pose[4] = 2.0 * (left - right) / std::max(left + right, 1.0);
+    return pose;
+}
+
+double OnlineCalibrationThread::calibrateCamera(const std::vector<std::vector<cv::Point2f> > &imagePoints,
+                                                cv::Mat &cameraMatrix, cv::Mat &distCoeffs, double &uncertainty)
+{
+    // The previous estimate is a good starting point once it exists
+    int flags = cameraMatrix.empty() ? 0 : cv::CALIB_USE_INTRINSIC_GUESS;
+
+    std::vector<cv::Mat> rvecs, tvecs;
+    double rms = cv::calibrateCamera(objectPoints, imagePoints, imageSize, cameraMatrix, distCoeffs,
+                                     rvecs, tvecs, flags);
+
+    cv::Vec4d deviation = intrinsicStdDev(objectPoints, imagePoints, cameraMatrix, distCoeffs, rvecs, tvecs, rms);
+    uncertainty = std::max(std::max(deviation[0], deviation[1]), std::max(deviation[2], deviation[3]));
+    return rms;
+}
@@ -0,0 +1,88 @@
+#ifndef ONLINECALIBRATIONTHREAD_H
+#define ONLINECALIBRATIONTHREAD_H
+
+//Qt
+#include <QQueue>
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+//Local
+#include "utilities.h"
+#include "streamingtask.h"
+
+#include <vector>
+
+/* Incremental stereo calibration while views are being captured.
+ * Every submitted view pair is checked for the chessboard and for new pose coverage (board position,
+ * size and tilt compared with the views accepted so far); accepted views update both intrinsics and
+ * the stereo extrinsics. The standard deviation of the focal lengths and principal points follows from
+ * the Jacobian of the reprojection, calibration has converged once it falls below maxUncertainty. */
+class OnlineCalibrationThread : public StreamingTask
+{
+    Q_OBJECT
+public:
+
+    OnlineCalibrationThread(cv::Size patternSize, float sideLength);
+
+    void submit(int view, const cv::Mat &grayLeft, const cv::Mat &grayRight);
+
+    double getMaxUncertainty() const;
+    void setMaxUncertainty(double value); //px
+
+    int getMinViews() const;
+    void setMinViews(int value);
+
+    double getMinPoseDistance() const;
+    void setMinPoseDistance(double value);
+
+private:
+
+    struct PendingView
+    {
+        int view;
+        cv::Mat grayLeft, grayRight;
+    };
+
+    QQueue<PendingView> pending; //every captured view is evaluated, none are dropped
+    PendingView current; //view being evaluated
+
+    cv::Size patternSize;
+    float sideLength;
+    cv::Size imageSize;
+
+    double maxUncertainty;
+    int minViews;
+    double minPoseDistance;
+    bool hasConverged;
+
+    std::vector<std::vector<cv::Point3f> > objectPoints;
+    std::vector<std::vector<cv::Point2f> > imagePointsLeft, imagePointsRight;
+    std::vector<cv::Vec<double, 5> > poses; //coverage descriptors of the accepted views
+
+    cv::Mat cameraMatrixLeft, cameraMatrixRight;
+    cv::Mat distCoeffsLeft, distCoeffsRight;
+    cv::Mat R, T, E, F;
+
+    void processView(const PendingView &view);
+    cv::Vec<double, 5> poseDescriptor(const std::vector<cv::Point2f> &corners) const;
+    double calibrateCamera(const std::vector<std::vector<cv::Point2f> > &imagePoints, cv::Mat &cameraMatrix,
+                           cv::Mat &distCoeffs, double &uncertainty);
+
+protected:
+
+    bool hasPending() const;
+    void takePending();
+    void clearPending();
+    void process();
+
+signals:
+
+    void viewAccepted(int view, int views, double rms, double uncertainty); //stereo RMS error, intrinsic std dev in px
+    void viewRejected(int view, const QString &reason);
+    void converged(int views, double rms, double uncertainty);
+
+};
+
+#endif // ONLINECALIBRATIONTHREAD_H
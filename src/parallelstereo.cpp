@@ -0,0 +1,109 @@
+#include "parallelstereo.h"
+#include "taskscheduler.h"
+
+#include <algorithm>
+
+/* Matches a range of stripes, every stripe with its own matcher and buffer. */
+class StereoStripes : public cv::ParallelLoopBody
+{
+public:
+
+    StereoStripes(std::vector<cv::StereoSGBM> &matchers, const cv::Mat &left, const cv::Mat &right,
+                  int stripeHeight, int overlap, cv::Mat &disp) :
+        matchers(matchers), left(left), right(right), stripeHeight(stripeHeight), overlap(overlap), disp(disp)
+    {
+    }
+
+    void operator()(const cv::Range &range) const
+    {
+        for(int stripe = range.start; stripe < range.end; stripe++)
+        {
+            int y0 = stripe * stripeHeight;
+            int y1 = std::min(y0 + stripeHeight, left.rows);
+            int c0 = std::max(0, y0 - overlap);
+            int c1 = std::min(left.rows, y1 + overlap);
+
+            cv::Mat stripeDisp;
+            matchers[stripe](left.rowRange(c0, c1), right.rowRange(c0, c1), stripeDisp);
+            stripeDisp.rowRange(y0 - c0, y1 - c0).copyTo(disp.rowRange(y0, y1));
+        }
+    }
+
+private:
+
+    std::vector<cv::StereoSGBM> &matchers;
+    cv::Mat left, right;
+    int stripeHeight;
+    int overlap;
+    cv::Mat disp;
+};
+
+// Copies the parameters only, a copied matcher would share the internal buffer of the source
+static void copyParameters(const cv::StereoSGBM &from, cv::StereoSGBM &to)
+{
+    to.minDisparity = from.minDisparity;
+    to.numberOfDisparities = from.numberOfDisparities;
+    to.SADWindowSize = from.SADWindowSize;
+    to.preFilterCap = from.preFilterCap;
+    to.uniquenessRatio = from.uniquenessRatio;
+    to.P1 = from.P1;
+    to.P2 = from.P2;
+    to.speckleWindowSize = from.speckleWindowSize;
+    to.speckleRange = from.speckleRange;
+    to.disp12MaxDiff = from.disp12MaxDiff;
+    to.fullDP = from.fullDP;
+}
+
+ParallelStereoSGBM::ParallelStereoSGBM(int stripes, int overlap)
+{
+    setStripes(stripes);
+    setOverlap(overlap);
+}
+
+int ParallelStereoSGBM::getStripes() const
+{
+    return stripes;
+}
+
+void ParallelStereoSGBM::setStripes(int value)
+{
+    stripes = std::max(value, 0);
+}
+
+int ParallelStereoSGBM::getOverlap() const
+{
+    return overlap;
+}
+
+void ParallelStereoSGBM::setOverlap(int value)
+{
+    overlap = std::max(value, 0);
+}
+
+void ParallelStereoSGBM::compute(const cv::StereoSGBM &stereo, const cv::Mat &left, const cv::Mat &right, cv::Mat &disp)
+{
+    int count = stripes > 0 ? stripes : TaskScheduler::instance()->parallelism();
+
+    // Stripes thinner than their context would mostly match overlap rows
+    count = std::max(1, std::min(count, left.rows / std::max(2 * overlap, 1)));
+    int stripeHeight = (left.rows + count - 1) / count;
+    count = (left.rows + stripeHeight - 1) / stripeHeight;
+
+    if((int)matchers.size() < count)
+    {
+        matchers.resize(count);
+    }
+    for(int i = 0; i < count; i++)
+    {
+        copyParameters(stereo, matchers[i]);
+    }
+
+    if(count == 1)
+    {
+        matchers[0](left, right, disp);
+        return;
+    }
+
+    disp.create(left.size(), CV_16SC1);
+    TaskScheduler::instance()->parallelFor(cv::Range(0, count), StereoStripes(matchers, left, right, stripeHeight, overlap, disp));
+}
@@ -0,0 +1,43 @@
+#ifndef PARALLELSTEREO_H
+#define PARALLELSTEREO_H
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <vector>
+
+/* Runs cv::StereoSGBM on overlapping row stripes of a rectified pair in parallel on the TaskScheduler and
+ * stitches the results.
+ * Each stripe is matched together with overlap rows of context above and below it, only its own rows
+ * are kept. The result equals the serial run except near stripe seams:
+ *  - the aggregation paths that run downwards (and diagonally) start at the top of the stripe context
+ *    instead of the top of the image, so within overlap rows below a seam a few pixels can get a
+ *    different disparity or be invalidated;
+ *  - speckle filtering sees each stripe separately, so a speckle region crossing a seam can be kept in
+ *    one stripe and removed in the other.
+ * With the default 32 rows of overlap the paths have converged and the differences are rare. */
+class ParallelStereoSGBM
+{
+public:
+
+    ParallelStereoSGBM(int stripes = 0, int overlap = 32);
+
+    void compute(const cv::StereoSGBM &stereo, const cv::Mat &left, const cv::Mat &right, cv::Mat &disp);
+
+    int getStripes() const;
+    void setStripes(int value); //0 uses one stripe per worker the TaskScheduler can use for the caller
+
+    int getOverlap() const;
+    void setOverlap(int value);
+
+private:
+
+    int stripes;
+    int overlap;
+
+    std::vector<cv::StereoSGBM> matchers; //one per stripe, keeps the matcher buffers between calls
+
+};
+
+#endif // PARALLELSTEREO_H
@@ -0,0 +1,49 @@
+#include "proximitythread.h"
+
+ProximityThread::ProximityThread(int rows, int cols) :
+    grid(rows, cols)
+{
+}
+
+void ProximityThread::submit(const StereoFramePtr &frame)
+{
+    QMutexLocker locker(&inputMutex);
+    pendingFrame = frame;
+    schedule();
+}
+
+bool ProximityThread::hasPending() const
+{
+    return !pendingFrame.isNull();
+}
+
+void ProximityThread::takePending()
+{
+    frame = pendingFrame;
+    pendingFrame.clear();
+}
+
+void ProximityThread::clearPending()
+{
+    pendingFrame.clear();
+}
+
+void ProximityThread::process()
+{
+    try
+    {
+        int64 start = cv::getTickCount();
+        cv::Mat cells = grid.compute(*frame);
+        double latency = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+        //Inform GUI of the obstacle grid of this frame pair
+        emit obstacleGrid(cells, latency);
+    }
+    catch(const cv::Exception& e)
+    {
+        emit sendMessage(QString::fromStdString(e.err), 2500);
+    }
+
+    // Hand the buffers back to the capture pool
+    frame.clear();
+}
@@ -0,0 +1,44 @@
+#ifndef PROXIMITYTHREAD_H
+#define PROXIMITYTHREAD_H
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+
+//Local
+#include "stereoframe.h"
+#include "obstaclegrid.h"
+#include "streamingtask.h"
+
+/* Persistent worker reporting the nearest obstacle in each image sector for every frame pair.
+ * Only the latest submitted pair is processed, older unprocessed pairs are dropped. */
+class ProximityThread : public StreamingTask
+{
+    Q_OBJECT
+public:
+
+    ProximityThread(int rows = 3, int cols = 5);
+
+    void submit(const StereoFramePtr &frame);
+
+private:
+
+    StereoFramePtr pendingFrame; //latest submitted frame pair, replaced by newer ones until taken
+    StereoFramePtr frame; //frame pair being processed
+
+    ObstacleGrid grid;
+
+protected:
+
+    bool hasPending() const;
+    void takePending();
+    void clearPending();
+    void process();
+
+signals:
+
+    void obstacleGrid(const cv::Mat &grid, double latency); //see ObstacleGrid::compute(), latency in ms
+    void sendMessage(const QString &message, int timeout);
+
+};
+
+#endif // PROXIMITYTHREAD_H
@@ -0,0 +1,178 @@
+#include "pyramidstereo.h"
+#include "taskscheduler.h"
+
+#include <algorithm>
+#include <climits>
+
+/* Refines a range of rows of the region of interest around the upsampled coarse disparity. */
+class RefineRows : public cv::ParallelLoopBody
+{
+public:
+
+    RefineRows(const cv::Mat &left, const cv::Mat &right, const cv::Mat &coarse, const cv::Rect &roi,
+               int levels, int coarseMinDisparity, int minDisparity, int maxDisparity, int radius, int halfWindow,
+               cv::Mat &disp) :
+        left(left), right(right), coarse(coarse), roi(roi), levels(levels), coarseMinDisparity(coarseMinDisparity),
+        minDisparity(minDisparity),
+        maxDisparity(maxDisparity), radius(radius), halfWindow(halfWindow), disp(disp)
+    {
+    }
+
+    void operator()(const cv::Range &range) const
+    {
+        const short invalid = (short)((minDisparity - 1) * 16);
+        std::vector<int> costs(2 * radius + 1);
+
+        for(int y = range.start; y < range.end; y++)
+        {
+            short *out = disp.ptr<short>(y);
+            const short *c = coarse.ptr<short>(std::min(y >> levels, coarse.rows - 1));
+
+            for(int x = roi.x; x < roi.x + roi.width; x++)
+            {
+                out[x] = invalid;
+
+                short coarseDisp = c[std::min(x >> levels, coarse.cols - 1)];
+                if(coarseDisp < coarseMinDisparity * 16 || y < halfWindow || y + halfWindow >= left.rows ||
+                   x < halfWindow || x + halfWindow >= left.cols)
+                {
+                    continue;
+                }
+
+                // Coarse disparities are in coarse pixels with 4 fractional bits
+                int center = ((coarseDisp << levels) + 8) >> 4;
+                int d0 = std::max(std::max(center - radius, minDisparity), 0);
+                int d1 = std::min(std::min(center + radius, maxDisparity), x - halfWindow);
+                if(d1 < d0)
+                {
+                    continue;
+                }
+
+                int best = -1, bestCost = INT_MAX;
+                for(int d = d0; d <= d1; d++)
+                {
+                    int cost = 0;
+                    for(int dy = -halfWindow; dy <= halfWindow; dy++)
+                    {
+                        const uchar *l = left.ptr<uchar>(y + dy) + x - halfWindow;
+                        const uchar *r = right.ptr<uchar>(y + dy) + x - d - halfWindow;
+                        for(int dx = 0; dx <= 2 * halfWindow; dx++)
+                        {
+                            cost += std::abs(l[dx] - r[dx]);
+                        }
+                    }
+                    costs[d - d0] = cost;
+                    if(cost < bestCost)
+                    {
+                        bestCost = cost;
+                        best = d;
+                    }
+                }
+
+                // Sub-pixel minimum from a parabola through the best cost and its neighbours
+                int offset = 0;
+                int i = best - d0;
+                if(best > d0 && best < d1)
+                {
+                    int denom = costs[i - 1] - 2 * costs[i] + costs[i + 1];
+                    if(denom > 0)
+                    {
+                        offset = (8 * (costs[i - 1] - costs[i + 1])) / denom;
+                    }
+                }
+
+                out[x] = (short)(best * 16 + offset);
+            }
+        }
+    }
+
+private:
+
+    cv::Mat left, right, coarse;
+    cv::Rect roi;
+    int levels, coarseMinDisparity, minDisparity, maxDisparity, radius, halfWindow;
+    cv::Mat disp;
+};
+
+PyramidStereoMatcher::PyramidStereoMatcher()
+{
+    levels = 2;
+    refineRadius = 3;
+    windowSize = 5;
+
+    // Grayscale pair
+    coarseStereo.preFilterCap = 63;
+    coarseStereo.SADWindowSize = 3;
+    coarseStereo.P1 = 8*coarseStereo.SADWindowSize*coarseStereo.SADWindowSize;
+    coarseStereo.P2 = 32*coarseStereo.SADWindowSize*coarseStereo.SADWindowSize;
+    coarseStereo.uniquenessRatio = 10;
+    coarseStereo.speckleWindowSize = 25;
+    coarseStereo.speckleRange = 8;
+    coarseStereo.disp12MaxDiff = 1;
+    coarseStereo.fullDP = false;
+}
+
+int PyramidStereoMatcher::getLevels() const
+{
+    return levels;
+}
+
+void PyramidStereoMatcher::setLevels(int value)
+{
+    levels = std::min(std::max(value, 1), 3);
+}
+
+int PyramidStereoMatcher::getRefineRadius() const
+{
+    return refineRadius;
+}
+
+void PyramidStereoMatcher::setRefineRadius(int value)
+{
+    refineRadius = std::max(value, 1);
+}
+
+int PyramidStereoMatcher::getWindowSize() const
+{
+    return windowSize;
+}
+
+void PyramidStereoMatcher::setWindowSize(int value)
+{
+    windowSize = std::max(value, 3) | 1;
+}
+
+void PyramidStereoMatcher::compute(const cv::Mat &left, const cv::Mat &right, const cv::Rect &roi,
+                                   int minDisparity, int numberOfDisparities, cv::Mat &disp)
+{
+    int maxDisparity = minDisparity + numberOfDisparities - 1;
+
+    // Coarse search over the whole pair, the disparity range shrinks with the image
+    cv::Mat coarseLeft = left, coarseRight = right;
+    for(int i = 0; i < levels; i++)
+    {
+        cv::pyrDown(coarseLeft, coarseLeft);
+        cv::pyrDown(coarseRight, coarseRight);
+    }
+
+    int scale = 1 << levels;
+    coarseStereo.minDisparity = minDisparity / scale;
+    coarseStereo.numberOfDisparities = std::max(16, ((maxDisparity / scale - coarseStereo.minDisparity + 1) + 15) / 16 * 16);
+
+    cv::Mat coarse;
+    coarseStereo(coarseLeft, coarseRight, coarse);
+
+    // Pixels outside the region stay invalid
+    disp.create(left.size(), CV_16SC1);
+    disp.setTo(cv::Scalar((minDisparity - 1) * 16));
+
+    cv::Rect area = roi & cv::Rect(0, 0, left.cols, left.rows);
+    if(area.area() == 0)
+    {
+        return;
+    }
+
+    TaskScheduler::instance()->parallelFor(cv::Range(area.y, area.y + area.height),
+                                           RefineRows(left, right, coarse, area, levels, coarseStereo.minDisparity,
+                                                      minDisparity, maxDisparity, refineRadius, windowSize / 2, disp));
+}
@@ -0,0 +1,44 @@
+#ifndef PYRAMIDSTEREO_H
+#define PYRAMIDSTEREO_H
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+/* Coarse-to-fine disparity for a rectified grayscale pair.
+ * SGBM runs on the pair downsampled levels times, then every pixel of the region of interest is
+ * refined at full resolution by block matching only refineRadius pixels around the upsampled coarse
+ * disparity. The result has the fixed-point layout of SGBM (CV_16SC1, 4 fractional bits) and marks
+ * pixels without a disparity with (minDisparity - 1) * 16.
+ *
+ * Quality/latency knobs: more levels make the coarse search cheaper but lose thin structures, a larger
+ * refine radius tolerates coarse errors at a linear cost, a larger window is smoother and slower. */
+class PyramidStereoMatcher
+{
+public:
+
+    PyramidStereoMatcher();
+
+    void compute(const cv::Mat &left, const cv::Mat &right, const cv::Rect &roi,
+                 int minDisparity, int numberOfDisparities, cv::Mat &disp);
+
+    int getLevels() const;
+    void setLevels(int value); //1..3, each level halves the coarse pair
+
+    int getRefineRadius() const;
+    void setRefineRadius(int value); //full resolution search is +-refineRadius around the coarse disparity
+
+    int getWindowSize() const;
+    void setWindowSize(int value); //odd block size of the refinement
+
+private:
+
+    int levels;
+    int refineRadius;
+    int windowSize;
+
+    cv::StereoSGBM coarseStereo;
+
+};
+
+#endif // PYRAMIDSTEREO_H
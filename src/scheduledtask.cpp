@@ -0,0 +1,101 @@
+#include "scheduledtask.h"
+
+/* Task running ScheduledTask::run(), the owner outlives it since its destructor waits for it. */
+class ScheduledTask::Runner : public Task
+{
+public:
+
+    Runner(ScheduledTask *owner, Priority priority) : Task(priority), owner(owner)
+    {
+    }
+
+protected:
+
+    void run()
+    {
+        owner->run();
+    }
+
+private:
+
+    ScheduledTask *owner;
+};
+
+ScheduledTask::ScheduledTask(Task::Priority priority)
+{
+    this->priority = priority;
+    doStop = false;
+}
+
+ScheduledTask::~ScheduledTask()
+{
+    // Last resort only, run() of a derived class may already be using destroyed members here
+    stop();
+    wait();
+}
+
+void ScheduledTask::start(const QList<TaskPtr> &dependencies)
+{
+    QMutexLocker locker(&taskMutex);
+    if(!task.isNull() && !task->isFinished())
+    {
+        return;
+    }
+
+    doStopMutex.lock();
+    doStop = false;
+    doStopMutex.unlock();
+
+    task = TaskPtr(new Runner(this, priority));
+    TaskScheduler::instance()->submit(task, dependencies);
+}
+
+void ScheduledTask::stop()
+{
+    QMutexLocker locker(&doStopMutex);
+    doStop = true;
+}
+
+bool ScheduledTask::isRunning() const
+{
+    QMutexLocker locker(&taskMutex);
+    return !task.isNull() && !task->isFinished();
+}
+
+bool ScheduledTask::isFinished() const
+{
+    QMutexLocker locker(&taskMutex);
+    return !task.isNull() && task->isFinished();
+}
+
+void ScheduledTask::wait()
+{
+    TaskPtr pending;
+    {
+        QMutexLocker locker(&taskMutex);
+        pending = task;
+    }
+
+    if(!pending.isNull())
+    {
+        TaskScheduler::instance()->wait(pending);
+    }
+}
+
+Task::Priority ScheduledTask::getPriority() const
+{
+    QMutexLocker locker(&taskMutex);
+    return priority;
+}
+
+void ScheduledTask::setPriority(Task::Priority value)
+{
+    QMutexLocker locker(&taskMutex);
+    priority = value;
+}
+
+bool ScheduledTask::stopRequested() const
+{
+    QMutexLocker locker(&doStopMutex);
+    return doStop;
+}
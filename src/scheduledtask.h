@@ -0,0 +1,52 @@
+#ifndef SCHEDULEDTASK_H
+#define SCHEDULEDTASK_H
+
+//Qt
+#include <QObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QList>
+
+//Local
+#include "taskscheduler.h"
+
+/* Base of the processing objects whose run() is executed as a task on the shared TaskScheduler instead of
+ * on a thread of their own. start(), isRunning(), isFinished() and wait() behave like their QThread
+ * counterparts, signals emitted from run() reach the GUI through queued connections as before. */
+class ScheduledTask : public QObject
+{
+    Q_OBJECT
+public:
+
+    ScheduledTask(Task::Priority priority = Task::Interactive);
+    virtual ~ScheduledTask(); //as with QThread, stop() and wait() before deleting a running task
+
+    void start(const QList<TaskPtr> &dependencies = QList<TaskPtr>()); //ignored while queued or running
+    void stop(); //asks run() to finish early, see stopRequested()
+
+    bool isRunning() const; //queued or running
+    bool isFinished() const;
+    void wait();
+
+    Task::Priority getPriority() const;
+    void setPriority(Task::Priority value);
+
+protected:
+
+    virtual void run() = 0;
+    bool stopRequested() const;
+
+private:
+
+    class Runner;
+
+    mutable QMutex taskMutex;
+    TaskPtr task;
+    Task::Priority priority;
+
+    volatile bool doStop;
+    mutable QMutex doStopMutex;
+
+};
+
+#endif // SCHEDULEDTASK_H
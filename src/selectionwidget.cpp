@@ -6,7 +6,7 @@
 #include <QDebug>
 
 SelectionWidget::SelectionWidget(QWidget *parent)
-    : QLabel(parent)
+    : FrameWidget(parent)
 {
     selectionStarted=false;
 }
@@ -18,7 +18,7 @@ SelectionWidget::~SelectionWidget()
 
 void SelectionWidget::paintEvent(QPaintEvent *e)
 {
-    QLabel::paintEvent(e);
+    FrameWidget::paintEvent(e);
     QPainter painter(this);
     painter.setPen(QPen(QBrush(QColor(0,0,0,180)),1,Qt::DashLine));
     painter.setBrush(QBrush(QColor(255,255,255,120)));
@@ -74,7 +74,7 @@ cv::Mat SelectionWidget::save(const QString &dataFolder)
 
     QString fileName = dataDirName + "/" + objectName + ".jpg";
 
-    this->pixmap()->copy(selectionRect).save(fileName);
+    this->frame().copy(selectionRect).save(fileName);
 
     cv::Mat img;
     img = cv::imread(fileName.toStdString(), CV_LOAD_IMAGE_GRAYSCALE);
@@ -5,7 +5,9 @@
 
 #include <opencv2/opencv.hpp>
 
-class SelectionWidget : public QLabel
+#include "framewidget.h"
+
+class SelectionWidget : public FrameWidget
 {
     Q_OBJECT
 
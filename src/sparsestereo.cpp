@@ -0,0 +1,193 @@
+#include "sparsestereo.h"
+
+#include <algorithm>
+#include <cmath>
+
+static bool strongerKeypoint(const cv::KeyPoint &a, const cv::KeyPoint &b)
+{
+    return a.response > b.response;
+}
+
+SparseStereoMatcher::SparseStereoMatcher()
+{
+    maxPoints = 150;
+    halfWindow = 5;
+    minScore = 0.8f;
+    uniquenessMargin = 0.02f;
+}
+
+int SparseStereoMatcher::getMaxPoints() const
+{
+    return maxPoints;
+}
+
+void SparseStereoMatcher::setMaxPoints(int value)
+{
+    maxPoints = std::max(value, 1);
+}
+
+float SparseStereoMatcher::getMinScore() const
+{
+    return minScore;
+}
+
+void SparseStereoMatcher::setMinScore(float value)
+{
+    minScore = value;
+}
+
+DepthStatistics SparseStereoMatcher::objectDepth(const StereoFrame &frame, const std::vector<cv::Point2f> &object,
+                                                 int minDisparity, int numberOfDisparities) const
+{
+    const StereoCalibration &calibration = frame.getCalibration();
+    if(object.size() < 3 || !calibration.isValid() || frame.left().empty() || frame.right().empty())
+    {
+        return DepthStatistics();
+    }
+
+    std::vector<cv::Point2f> points, rectified;
+    objectPoints(frame, object, points);
+    calibration.rectifyPointsLeft(points, rectified);
+    if(rectified.empty())
+    {
+        return DepthStatistics();
+    }
+
+    // Band of the rectified images holding every matching window and its search range
+    cv::Size imageSize = calibration.map_l1.size();
+    int maxDisparity = minDisparity + numberOfDisparities - 1;
+    cv::Rect box = cv::boundingRect(rectified);
+    int x0 = std::max(0, box.x - maxDisparity - halfWindow - 1);
+    int x1 = std::min(imageSize.width, box.x + box.width + halfWindow + 2);
+    int y0 = std::max(0, box.y - halfWindow - 1);
+    int y1 = std::min(imageSize.height, box.y + box.height + halfWindow + 2);
+    if(x1 <= x0 || y1 <= y0)
+    {
+        return DepthStatistics();
+    }
+    cv::Rect band(x0, y0, x1 - x0, y1 - y0);
+
+    cv::Mat bandLeft, bandRight;
+    remapToGray(frame.left(), calibration.map_l1(band), calibration.map_l2(band), bandLeft);
+    remapToGray(frame.right(), calibration.map_r1(band), calibration.map_r2(band), bandRight);
+
+    // Z = q23 / (q32 * d + q33)
+    cv::Mat_<double> q;
+    calibration.Q.convertTo(q, CV_64F);
+
+    int window = 2 * halfWindow + 1;
+    std::vector<float> depths;
+    depths.reserve(rectified.size());
+    cv::Mat scores;
+
+    for(size_t i = 0; i < rectified.size(); i++)
+    {
+        int xl = cvRound(rectified[i].x) - x0;
+        int yl = cvRound(rectified[i].y) - y0;
+        if(xl < halfWindow || xl + halfWindow >= band.width || yl < halfWindow || yl + halfWindow >= band.height)
+        {
+            continue;
+        }
+
+        // Candidate positions in the right image lie on the same row, minDisparity..maxDisparity to the left
+        int xrMin = std::max(halfWindow, xl - maxDisparity);
+        int xrMax = std::min(band.width - halfWindow - 1, xl - minDisparity);
+        if(xrMax - xrMin < 2)
+        {
+            continue;
+        }
+
+        cv::Mat patch = bandLeft(cv::Rect(xl - halfWindow, yl - halfWindow, window, window));
+        cv::Mat strip = bandRight(cv::Rect(xrMin - halfWindow, yl - halfWindow, xrMax - xrMin + window, window));
+        cv::matchTemplate(strip, patch, scores, CV_TM_CCOEFF_NORMED);
+
+        const float *s = scores.ptr<float>(0);
+        int n = scores.cols;
+        int best = std::max_element(s, s + n) - s;
+        if(s[best] < minScore)
+        {
+            continue;
+        }
+
+        // Repetitive texture gives several equally good candidates, drop ambiguous matches
+        bool unique = true;
+        for(int j = 0; j < n && unique; j++)
+        {
+            if(std::abs(j - best) > 1 && s[j] > s[best] - uniquenessMargin)
+            {
+                unique = false;
+            }
+        }
+        if(!unique)
+        {
+            continue;
+        }
+
+        // Sub-pixel peak from a parabola through the best score and its neighbours
+        float offset = 0.f;
+        if(best > 0 && best < n - 1)
+        {
+            float denom = s[best - 1] - 2.f * s[best] + s[best + 1];
+            if(denom < 0.f)
+            {
+                offset = 0.5f * (s[best - 1] - s[best + 1]) / denom;
+            }
+        }
+
+        double d = xl - (xrMin + best + offset);
+        double w = q(3, 2) * d + q(3, 3);
+        if(w > 0.0)
+        {
+            depths.push_back((float)(q(2, 3) / w));
+        }
+    }
+
+    return sampleDepthStatistics(depths, rectified.size());
+}
+
+void SparseStereoMatcher::objectPoints(const StereoFrame &frame, const std::vector<cv::Point2f> &object,
+                                       std::vector<cv::Point2f> &points) const
+{
+    points.clear();
+
+    // Keypoints of the categorizer when it processed this pair, strongest first
+    std::vector<cv::KeyPoint> keypoints = frame.keypointsLeft();
+    if(!keypoints.empty())
+    {
+        std::sort(keypoints.begin(), keypoints.end(), strongerKeypoint);
+        for(size_t i = 0; i < keypoints.size() && (int)points.size() < maxPoints; i++)
+        {
+            if(cv::pointPolygonTest(object, keypoints[i].pt, false) >= 0)
+            {
+                points.push_back(keypoints[i].pt);
+            }
+        }
+        return;
+    }
+
+    // Otherwise pick corners inside the object quad only
+    const cv::Mat &gray = frame.grayLeft();
+    cv::Rect box = cv::boundingRect(object) & cv::Rect(0, 0, gray.cols, gray.rows);
+    if(box.area() == 0)
+    {
+        return;
+    }
+
+    std::vector<cv::Point> quad;
+    for(size_t i = 0; i < object.size(); i++)
+    {
+        quad.push_back(cv::Point(cvRound(object[i].x) - box.x, cvRound(object[i].y) - box.y));
+    }
+
+    cv::Mat mask = cv::Mat::zeros(box.size(), CV_8UC1);
+    const cv::Point *polygon = &quad[0];
+    int count = quad.size();
+    cv::fillPoly(mask, &polygon, &count, 1, cv::Scalar(255));
+
+    cv::goodFeaturesToTrack(gray(box), points, maxPoints, 0.01, 5, mask);
+    for(size_t i = 0; i < points.size(); i++)
+    {
+        points[i].x += box.x;
+        points[i].y += box.y;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef SPARSESTEREO_H
+#define SPARSESTEREO_H
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+
+//Local
+#include "stereoframe.h"
+#include "depthstatistics.h"
+#include "grayremap.h"
+
+#include <vector>
+
+/* Distance to a textured object from a few matched points instead of a dense disparity map.
+ * Keypoints inside the object quad are rectified with the calibration and matched against the right
+ * image along their epipolar line (the same row after rectification) within the disparity window.
+ * Only the rows around the keypoints are rectified, the depth of every match comes straight from Q. */
+class SparseStereoMatcher
+{
+public:
+
+    SparseStereoMatcher();
+
+    DepthStatistics objectDepth(const StereoFrame &frame, const std::vector<cv::Point2f> &object,
+                                int minDisparity, int numberOfDisparities) const;
+
+    int getMaxPoints() const;
+    void setMaxPoints(int value);
+
+    float getMinScore() const;
+    void setMinScore(float value);
+
+private:
+
+    int maxPoints; //strongest keypoints used per object
+    int halfWindow; //matching window is (2 * halfWindow + 1)^2
+    float minScore; //minimum normalized correlation of a match
+    float uniquenessMargin; //best score must exceed every other candidate by this much
+
+    void objectPoints(const StereoFrame &frame, const std::vector<cv::Point2f> &object,
+                      std::vector<cv::Point2f> &points) const;
+
+};
+
+#endif // SPARSESTEREO_H
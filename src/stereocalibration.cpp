@@ -0,0 +1,267 @@
+#include "stereocalibration.h"
+#include "taskscheduler.h"
+
+//Qt
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+
+#include <algorithm>
+
+static const quint32 mapCacheMagic = 0x534d4150; //"SMAP"
+static const qint32 mapCacheVersion = 1;
+
+/* Computes the rectification maps of one camera for a range of row stripes.
+ * Shifting the principal point of the new camera matrix by the first row of a stripe makes
+ * initUndistortRectifyMap produce exactly the rows of the full map, so stripes can be built
+ * independently and written straight into the preallocated maps. */
+class RectifyMapStripes : public cv::ParallelLoopBody
+{
+public:
+
+    RectifyMapStripes(const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs, const cv::Mat &R,
+                      const cv::Mat &P, cv::Size imageSize, int stripeHeight, cv::Mat &map1, cv::Mat &map2) :
+        cameraMatrix(cameraMatrix), distCoeffs(distCoeffs), R(R), imageSize(imageSize),
+        stripeHeight(stripeHeight), map1(map1), map2(map2)
+    {
+        P.convertTo(this->P, CV_64F);
+    }
+
+    void operator()(const cv::Range &range) const
+    {
+        for(int stripe = range.start; stripe < range.end; stripe++)
+        {
+            int y0 = stripe * stripeHeight;
+            int y1 = std::min(y0 + stripeHeight, imageSize.height);
+
+            cv::Mat stripeP = P.clone();
+            stripeP.at<double>(1, 2) -= y0;
+
+            cv::Mat stripeMap1 = map1.rowRange(y0, y1);
+            cv::Mat stripeMap2 = map2.rowRange(y0, y1);
+            cv::initUndistortRectifyMap(cameraMatrix, distCoeffs, R, stripeP,
+                                        cv::Size(imageSize.width, y1 - y0), CV_16SC2, stripeMap1, stripeMap2);
+        }
+    }
+
+private:
+
+    cv::Mat cameraMatrix, distCoeffs, R, P;
+    cv::Size imageSize;
+    int stripeHeight;
+    cv::Mat map1, map2;
+};
+
+StereoCalibration::StereoCalibration()
+{
+    imageSize = cv::Size(0, 0);
+}
+
+bool StereoCalibration::load(const QString &fileName)
+{
+    *this = StereoCalibration();
+
+    cv::FileStorage fs(fileName.toStdString(), cv::FileStorage::READ);
+    if(!fs.isOpened())
+    {
+        return false;
+    }
+
+    imageSize.width = (int)fs["imageWidth"];
+    imageSize.height = (int)fs["imageHeight"];
+    fs["cameraMatrixLeft"] >> cameraMatrixLeft;
+    fs["cameraMatrixRight"] >> cameraMatrixRight;
+    fs["distCoeffsLeft"] >> distCoeffsLeft;
+    fs["distCoeffsRight"] >> distCoeffsRight;
+    fs["R"] >> R;
+    fs["T"] >> T;
+    fs["E"] >> E;
+    fs["F"] >> F;
+    fs["Rl"] >> Rl;
+    fs["Rr"] >> Rr;
+    fs["Pl"] >> Pl;
+    fs["Pr"] >> Pr;
+    fs["Q"] >> Q;
+
+    //Files written before the maps were dropped from the XML carry no image size, read their maps instead
+    if(imageSize.area() == 0)
+    {
+        fs["map_l1"] >> map_l1;
+        fs["map_l2"] >> map_l2;
+        fs["map_r1"] >> map_r1;
+        fs["map_r2"] >> map_r2;
+        fs.release();
+
+        imageSize = map_l1.size();
+        return isValid();
+    }
+    fs.release();
+
+    if(!loadMapCache(fileName))
+    {
+        initRectificationMaps();
+    }
+
+    return isValid();
+}
+
+void StereoCalibration::save(const QString &fileName) const
+{
+    cv::FileStorage fs(fileName.toStdString(), cv::FileStorage::WRITE);
+    fs << "imageWidth" << imageSize.width;
+    fs << "imageHeight" << imageSize.height;
+    fs << "cameraMatrixLeft" << cameraMatrixLeft;
+    fs << "cameraMatrixRight" << cameraMatrixRight;
+    fs << "distCoeffsLeft" << distCoeffsLeft;
+    fs << "distCoeffsRight" << distCoeffsRight;
+    fs << "R" << R;
+    fs << "T" << T;
+    fs << "E" << E;
+    fs << "F" << F;
+    fs << "Rl" << Rl;
+    fs << "Rr" << Rr;
+    fs << "Pl" << Pl;
+    fs << "Pr" << Pr;
+    fs << "Q" << Q;
+    fs.release();
+
+    saveMapCache(fileName);
+}
+
+void StereoCalibration::initRectificationMaps()
+{
+    if(cameraMatrixLeft.empty() || cameraMatrixRight.empty() || distCoeffsLeft.empty() ||
+       distCoeffsRight.empty() || Rl.empty() || Rr.empty() || Pl.empty() || Pr.empty() || imageSize.area() == 0)
+    {
+        return;
+    }
+
+    map_l1.create(imageSize, CV_16SC2);
+    map_l2.create(imageSize, CV_16UC1);
+    map_r1.create(imageSize, CV_16SC2);
+    map_r2.create(imageSize, CV_16UC1);
+
+    int stripes = std::min(imageSize.height, std::max(1, TaskScheduler::instance()->parallelism() * 4));
+    int stripeHeight = (imageSize.height + stripes - 1) / stripes;
+    stripes = (imageSize.height + stripeHeight - 1) / stripeHeight;
+
+    TaskScheduler::instance()->parallelFor(cv::Range(0, stripes),
+                                           RectifyMapStripes(cameraMatrixLeft, distCoeffsLeft, Rl, Pl,
+                                                             imageSize, stripeHeight, map_l1, map_l2));
+    TaskScheduler::instance()->parallelFor(cv::Range(0, stripes),
+                                           RectifyMapStripes(cameraMatrixRight, distCoeffsRight, Rr, Pr,
+                                                             imageSize, stripeHeight, map_r1, map_r2));
+}
+
+bool StereoCalibration::isValid() const
+{
+    return !map_l1.empty() && !map_l2.empty() && !map_r1.empty() && !map_r2.empty() && !Q.empty();
+}
+
+void StereoCalibration::rectifyPointsLeft(const std::vector<cv::Point2f> &points,
+                                          std::vector<cv::Point2f> &rectified) const
+{
+    if(points.empty())
+    {
+        rectified.clear();
+        return;
+    }
+
+    //Calibration files that only carry maps cannot map points, keep them where they are
+    if(cameraMatrixLeft.empty() || distCoeffsLeft.empty() || Rl.empty() || Pl.empty())
+    {
+        rectified = points;
+        return;
+    }
+
+    cv::undistortPoints(points, rectified, cameraMatrixLeft, distCoeffsLeft, Rl, Pl);
+}
+
+cv::Rect StereoCalibration::rectifiedBoundingRect(const std::vector<cv::Point2f> &points) const
+{
+    std::vector<cv::Point2f> rectified;
+    rectifyPointsLeft(points, rectified);
+    if(rectified.empty())
+    {
+        return cv::Rect();
+    }
+
+    return cv::boundingRect(rectified) & cv::Rect(0, 0, imageSize.width, imageSize.height);
+}
+
+QString StereoCalibration::mapCacheFileName(const QString &fileName)
+{
+    QFileInfo info(fileName);
+    return info.absolutePath() + "/" + info.completeBaseName() + ".maps";
+}
+
+bool StereoCalibration::loadMapCache(const QString &fileName)
+{
+    QFileInfo cacheInfo(mapCacheFileName(fileName));
+
+    //A cache older than the calibration file belongs to a previous calibration
+    if(!cacheInfo.exists() || cacheInfo.lastModified() < QFileInfo(fileName).lastModified())
+    {
+        return false;
+    }
+
+    QFile file(cacheInfo.absoluteFilePath());
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    QDataStream in(&file);
+    quint32 magic;
+    qint32 version, width, height, type1, type2;
+    in >> magic >> version >> width >> height >> type1 >> type2;
+
+    if(in.status() != QDataStream::Ok || magic != mapCacheMagic || version != mapCacheVersion ||
+       width != imageSize.width || height != imageSize.height)
+    {
+        return false;
+    }
+
+    cv::Mat maps[4];
+    int types[4] = {type1, type2, type1, type2};
+    for(int i = 0; i < 4; i++)
+    {
+        maps[i].create(imageSize, types[i]);
+        int bytes = (int)(maps[i].total() * maps[i].elemSize());
+        if(in.readRawData((char*)maps[i].data, bytes) != bytes)
+        {
+            return false;
+        }
+    }
+
+    map_l1 = maps[0];
+    map_l2 = maps[1];
+    map_r1 = maps[2];
+    map_r2 = maps[3];
+    return true;
+}
+
+void StereoCalibration::saveMapCache(const QString &fileName) const
+{
+    if(!isValid())
+    {
+        return;
+    }
+
+    QFile file(mapCacheFileName(fileName));
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        return;
+    }
+
+    QDataStream out(&file);
+    out << mapCacheMagic << mapCacheVersion << (qint32)imageSize.width << (qint32)imageSize.height
+        << (qint32)map_l1.type() << (qint32)map_l2.type();
+
+    const cv::Mat maps[4] = {map_l1, map_l2, map_r1, map_r2};
+    for(int i = 0; i < 4; i++)
+    {
+        cv::Mat map = maps[i].isContinuous() ? maps[i] : maps[i].clone();
+        out.writeRawData((const char*)map.data, (int)(map.total() * map.elemSize()));
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef STEREOCALIBRATION_H
+#define STEREOCALIBRATION_H
+
+//Qt
+#include <QString>
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <vector>
+
+/* Stereo calibration and rectification parameters.
+ * Only the parameters are written to the calibration file, the per-pixel rectification maps are
+ * rebuilt from them on load (or read back from the binary map cache written next to the file). */
+struct StereoCalibration
+{
+    StereoCalibration();
+
+    bool load(const QString &fileName); //load parameters and restore rectification maps
+    void save(const QString &fileName) const; //save parameters and the binary map cache
+
+    void initRectificationMaps(); //build rectification maps in parallel row stripes
+    bool isValid() const;
+
+    void rectifyPointsLeft(const std::vector<cv::Point2f> &points, std::vector<cv::Point2f> &rectified) const;
+    cv::Rect rectifiedBoundingRect(const std::vector<cv::Point2f> &points) const; //left image points, clipped to the image
+
+    static QString mapCacheFileName(const QString &fileName);
+
+    cv::Size imageSize;
+    cv::Mat cameraMatrixLeft, cameraMatrixRight;
+    cv::Mat distCoeffsLeft, distCoeffsRight;
+    cv::Mat R, T, E, F; //stereo calibration information
+    cv::Mat Rl, Rr, Pl, Pr; //rectification transforms and projections
+    cv::Mat Q; //disparity-to-depth mapping matrix
+
+    cv::Mat map_l1, map_l2, map_r1, map_r2; //pixel maps for rectification, never serialized as XML
+
+private:
+
+    bool loadMapCache(const QString &fileName);
+    void saveMapCache(const QString &fileName) const;
+
+};
+
+#endif // STEREOCALIBRATION_H
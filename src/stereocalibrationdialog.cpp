@@ -28,6 +28,7 @@ StereoCalibrationDialog::StereoCalibrationDialog(QWidget *parent, int leftCamId,
     }
 
     timer = new QTimer(this);
+    timer->setInterval(displayRefreshInterval());
     connect(timer, SIGNAL(timeout()), this, SLOT(updateFrame()));
 
     imageCounter = 0;
@@ -35,10 +36,29 @@ StereoCalibrationDialog::StereoCalibrationDialog(QWidget *parent, int leftCamId,
     patternSize.width = 0;
     squareSize = 0.f;
 
+    foundLeft = false;
+    foundRight = false;
+
+    chessboardThread = new ChessboardThread();
+    qRegisterMetaType<std::vector<cv::Point2f> >("std::vector<cv::Point2f>");
+    qRegisterMetaType<cv::Size>("cv::Size");
+    connect(chessboardThread, SIGNAL(chessboardCorners(std::vector<cv::Point2f>,bool,std::vector<cv::Point2f>,bool,cv::Size)),
+            this, SLOT(setChessboardCorners(std::vector<cv::Point2f>,bool,std::vector<cv::Point2f>,bool,cv::Size)));
+    chessboardThread->start();
+
+    onlineCalibrationThread = NULL;
+    viewCounter = 0;
+
 }
 
 StereoCalibrationDialog::~StereoCalibrationDialog()
 {
+    chessboardThread->stop();
+    chessboardThread->wait();
+    delete chessboardThread;
+
+    stopOnlineCalibration();
+
     captureLeft.release();
     captureRight.release();
     delete ui;
@@ -71,6 +91,18 @@ void StereoCalibrationDialog::createCalibDirs()
     addDirectory(calibDir + "Right/");
 }
 
+void StereoCalibrationDialog::stopOnlineCalibration()
+{
+    if(onlineCalibrationThread != NULL)
+    {
+        onlineCalibrationThread->stop();
+        onlineCalibrationThread->wait();
+        delete onlineCalibrationThread;
+        onlineCalibrationThread = NULL;
+    }
+    pendingViews.clear();
+}
+
 void StereoCalibrationDialog::updateFrame()
 {
     captureLeft.grab();
@@ -81,34 +113,47 @@ void StereoCalibrationDialog::updateFrame()
 
     if(!currentFrameLeft.empty() && !currentFrameRight.empty())
     {
-        cv::Mat frameLeftCopy = currentFrameLeft.clone();
-        cv::Mat frameRightCopy = currentFrameRight.clone();
+        // Convert into the preview buffers first, the chessboard overlay is drawn on top of them
+        cv::Mat displayLeft = ui->leftCameraLabel->frameBuffer(currentFrameLeft.size());
+        cv::Mat displayRight = ui->rightCameraLabel->frameBuffer(currentFrameRight.size());
+        bgrToRgb32(currentFrameLeft, displayLeft);
+        bgrToRgb32(currentFrameRight, displayRight);
 
         if(ui->checkBox->isChecked())
         {
-            detectChessboard(frameLeftCopy, patternSize);
-            detectChessboard(frameRightCopy, patternSize);
-        }
-
-        QImage qframeL, qframeR;
-        qframeL = MatToQImage(frameLeftCopy);
-        qframeR = MatToQImage(frameRightCopy);
-
-        frameLeft = MatToQImage(currentFrameLeft);
-        frameRight = MatToQImage(currentFrameRight);
+            // Detection runs in the background on the latest pair, the last result is drawn meanwhile.
+            // Chessboards with fewer than 3 inner corners per side are rejected by findChessboardCorners
+            if(patternSize.width > 2 && patternSize.height > 2)
+            {
+                StereoFrame frame(currentFrameLeft, currentFrameRight);
+                chessboardThread->submit(frame.grayLeft(), frame.grayRight(), patternSize);
+            }
 
-        pixmapLeft = QPixmap::fromImage(qframeL).scaled(currentFrameLeft.cols,
-                                                  currentFrameRight.rows, Qt::KeepAspectRatio);
+            if(cornersPatternSize == patternSize)
+            {
+                cv::drawChessboardCorners(displayLeft, patternSize, cv::Mat(cornersLeft), foundLeft);
+                cv::drawChessboardCorners(displayRight, patternSize, cv::Mat(cornersRight), foundRight);
+            }
+        }
 
-        pixmapRight = QPixmap::fromImage(qframeR).scaled(currentFrameRight.cols,
-                                                  currentFrameRight.rows, Qt::KeepAspectRatio);
-        ui->leftCameraLabel->setPixmap(pixmapLeft);
-        ui->rightCameraLabel->setPixmap(pixmapRight);
+        ui->leftCameraLabel->presentFrame();
+        ui->rightCameraLabel->presentFrame();
 
     }
 
 }
 
+void StereoCalibrationDialog::setChessboardCorners(const std::vector<cv::Point2f> &cornersLeft, bool foundLeft,
+                                                   const std::vector<cv::Point2f> &cornersRight, bool foundRight,
+                                                   const cv::Size &patternSize)
+{
+    this->cornersLeft = cornersLeft;
+    this->cornersRight = cornersRight;
+    this->foundLeft = foundLeft;
+    this->foundRight = foundRight;
+    cornersPatternSize = patternSize;
+}
+
 void StereoCalibrationDialog::on_cancelButton_clicked()
 {
     reject();
@@ -116,19 +161,69 @@ void StereoCalibrationDialog::on_cancelButton_clicked()
 
 void StereoCalibrationDialog::on_captureButton_clicked()
 {
-    if(timer->isActive())
+    if(timer->isActive() && ui->incrementalCheckBox->isChecked() && onlineCalibrationThread != NULL)
+    {
+        // The frames are only written once the view has been accepted
+        int view = ++viewCounter;
+        pendingViews.insert(view, std::make_pair(currentFrameLeft.clone(), currentFrameRight.clone()));
+
+        StereoFrame frame(pendingViews[view].first, pendingViews[view].second);
+        onlineCalibrationThread->submit(view, frame.grayLeft(), frame.grayRight());
+
+        ui->leftLine->setText("Evaluating view " + QString::number(view) + "...");
+    }
+    else if(timer->isActive())
     {
         QString leftFileName = calibDir + "Left/" + "left" + QString::number(++imageCounter) + ".jpg";
         QString rightFileName = calibDir + "Right/" + "right" + QString::number(imageCounter) + ".jpg";
 
-        frameLeft.save(leftFileName);
-        frameRight.save(rightFileName);
+        cv::imwrite(leftFileName.toStdString(), currentFrameLeft);
+        cv::imwrite(rightFileName.toStdString(), currentFrameRight);
 
         ui->leftLine->setText("Captured image \"left" + QString::number(imageCounter) + ".jpg\"");
         ui->rightLine->setText("Captured image \"right" + QString::number(imageCounter) + ".jpg\"");
     }
 }
 
+void StereoCalibrationDialog::viewAccepted(int view, int views, double rms, double uncertainty)
+{
+    if(!pendingViews.contains(view))
+    {
+        return;
+    }
+
+    std::pair<cv::Mat, cv::Mat> frames = pendingViews.take(view);
+    QString leftFileName = calibDir + "Left/" + "left" + QString::number(++imageCounter) + ".jpg";
+    QString rightFileName = calibDir + "Right/" + "right" + QString::number(imageCounter) + ".jpg";
+    cv::imwrite(leftFileName.toStdString(), frames.first);
+    cv::imwrite(rightFileName.toStdString(), frames.second);
+
+    ui->leftLine->setText("Accepted view " + QString::number(view) + " as \"left" + QString::number(imageCounter) +
+                          ".jpg\" (" + QString::number(views) + " views)");
+    if(rms > 0.0)
+    {
+        ui->rightLine->setText(QString("RMS error %1 px, intrinsic uncertainty %2 px")
+                               .arg(rms, 0, 'f', 3).arg(uncertainty, 0, 'f', 2));
+    }
+    else
+    {
+        ui->rightLine->setText("Waiting for more views before estimating");
+    }
+}
+
+void StereoCalibrationDialog::viewRejected(int view, const QString &reason)
+{
+    pendingViews.remove(view);
+    ui->leftLine->setText("Rejected view " + QString::number(view) + ": " + reason);
+}
+
+void StereoCalibrationDialog::calibrationConverged(int views, double rms, double uncertainty)
+{
+    ui->rightLine->setText(QString("Converged after %1 views, RMS error %2 px, intrinsic uncertainty %3 px")
+                           .arg(views).arg(rms, 0, 'f', 3).arg(uncertainty, 0, 'f', 2));
+    on_doneButton_clicked();
+}
+
 void StereoCalibrationDialog::on_doneButton_clicked()
 {
     timer->stop();
@@ -168,6 +263,17 @@ void StereoCalibrationDialog::on_submitButton_clicked()
         squareSize = ui->squareSizeLength->text().toFloat();
         QMessageBox::information(this, "Cheesboard pattern size submitted", "Chessboard pattern size submitted without issues");
 
+        // Views accepted for another pattern are of no use to the new one
+        stopOnlineCalibration();
+        onlineCalibrationThread = new OnlineCalibrationThread(patternSize, squareSize);
+        connect(onlineCalibrationThread, SIGNAL(viewAccepted(int,int,double,double)),
+                this, SLOT(viewAccepted(int,int,double,double)));
+        connect(onlineCalibrationThread, SIGNAL(viewRejected(int,QString)), this, SLOT(viewRejected(int,QString)));
+        connect(onlineCalibrationThread, SIGNAL(converged(int,double,double)),
+                this, SLOT(calibrationConverged(int,double,double)));
+        onlineCalibrationThread->start();
+        ui->captureButton->setEnabled(true);
+
         ui->leftCameraLabel->setText("");
         timer->start();
     }
@@ -6,6 +6,7 @@
 #include <QTimer>
 #include <QImage>
 #include <QMessageBox>
+#include <QMap>
 
 //OpenCV
 #include <opencv2/opencv.hpp>
@@ -13,6 +14,12 @@
 
 //Local
 #include "utilities.h"
+#include "stereoframe.h"
+#include "framewidget.h"
+#include "chessboardthread.h"
+#include "onlinecalibrationthread.h"
+
+#include <utility>
 
 namespace Ui {
 class StereoCalibrationDialog;
@@ -45,24 +52,35 @@ private:
 
     cv::Mat currentFrameLeft; // Current frame in cv::Mat format
     cv::Mat currentFrameRight; // Current frame in cv::Mat format
-    QImage frameLeft; // Current frame in QImage format
-    QImage frameRight; // Current frame in QImage format
 
     QTimer *timer;
     cv::VideoCapture captureLeft;
     cv::VideoCapture captureRight;
-    QPixmap pixmapLeft;
-    QPixmap pixmapRight;
     int imageCounter;
 
     cv::Size patternSize;
     float squareSize;
 
+    ChessboardThread *chessboardThread; //detects the chessboard for the preview off the GUI thread
+    std::vector<cv::Point2f> cornersLeft, cornersRight; //last detection result, drawn on every frame
+    bool foundLeft, foundRight;
+    cv::Size cornersPatternSize;
+
+    OnlineCalibrationThread *onlineCalibrationThread; //incremental calibration, created once the pattern is known
+    QMap<int, std::pair<cv::Mat, cv::Mat> > pendingViews; //captured frames waiting for acceptance, by view id
+    int viewCounter;
+
     void createCalibDirs();
+    void stopOnlineCalibration();
 
 private slots:
 
     void updateFrame();
+    void setChessboardCorners(const std::vector<cv::Point2f> &cornersLeft, bool foundLeft,
+                              const std::vector<cv::Point2f> &cornersRight, bool foundRight, const cv::Size &patternSize);
+    void viewAccepted(int view, int views, double rms, double uncertainty);
+    void viewRejected(int view, const QString &reason);
+    void calibrationConverged(int views, double rms, double uncertainty);
     void on_cancelButton_clicked();
     void on_captureButton_clicked();
     void on_doneButton_clicked();
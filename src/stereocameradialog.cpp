@@ -49,15 +49,7 @@ void StereoCameraDialog::on_browseButton_clicked()
 
 void StereoCameraDialog::loadCalibData(const QString &fileName)
 {
-    cv::FileStorage fs(fileName.toStdString(), cv::FileStorage::READ);
-    fs["Q"] >> Q;
-    fs["map_l1"] >> map_l1;
-    fs["map_l2"] >> map_l2;
-    fs["map_r1"] >> map_r1;
-    fs["map_r2"] >> map_r2;
-    fs.release();
-
-    if(!map_l1.empty() && !map_l2.empty() && !map_r1.empty() && !map_r2.empty() && !Q.empty())
+    if(calibration.load(fileName))
     {
         QMessageBox::information(this, "Calibration data", "Calibration data loaded successfully.");
     }
@@ -86,53 +78,12 @@ void StereoCameraDialog::setRightCameraIdx(int value)
     rightCameraIdx = value;
 }
 
-cv::Mat StereoCameraDialog::getQ() const
-{
-    return Q;
-}
-
-void StereoCameraDialog::setQ(const cv::Mat &value)
-{
-    Q = value;
-}
-
-cv::Mat StereoCameraDialog::getMap_r2() const
-{
-    return map_r2;
-}
-
-void StereoCameraDialog::setMap_r2(const cv::Mat &value)
-{
-    map_r2 = value;
-}
-
-cv::Mat StereoCameraDialog::getMap_r1() const
+StereoCalibration StereoCameraDialog::getCalibration() const
 {
-    return map_r1;
+    return calibration;
 }
 
-void StereoCameraDialog::setMap_r1(const cv::Mat &value)
+void StereoCameraDialog::setCalibration(const StereoCalibration &value)
 {
-    map_r1 = value;
+    calibration = value;
 }
-
-cv::Mat StereoCameraDialog::getMap_l2() const
-{
-    return map_l2;
-}
-
-void StereoCameraDialog::setMap_l2(const cv::Mat &value)
-{
-    map_l2 = value;
-}
-
-cv::Mat StereoCameraDialog::getMap_l1() const
-{
-    return map_l1;
-}
-
-void StereoCameraDialog::setMap_l1(const cv::Mat &value)
-{
-    map_l1 = value;
-}
-
@@ -9,6 +9,9 @@
 //OpenCV
 #include <opencv2/opencv.hpp>
 
+//Local
+#include "stereocalibration.h"
+
 namespace Ui {
 class StereoCameraDialog;
 }
@@ -28,20 +31,8 @@ public:
     int getRightCameraIdx() const;
     void setRightCameraIdx(int value);
 
-    cv::Mat getMap_l1() const;
-    void setMap_l1(const cv::Mat &value);
-
-    cv::Mat getMap_l2() const;
-    void setMap_l2(const cv::Mat &value);
-
-    cv::Mat getMap_r1() const;
-    void setMap_r1(const cv::Mat &value);
-
-    cv::Mat getMap_r2() const;
-    void setMap_r2(const cv::Mat &value);
-
-    cv::Mat getQ() const;
-    void setQ(const cv::Mat &value);
+    StereoCalibration getCalibration() const;
+    void setCalibration(const StereoCalibration &value);
 
 private slots:
 
@@ -57,9 +48,7 @@ private:
     QString calibDataDirectory;
 
     /* Needed to calculate distance(disparity) */
-    cv::Mat map_l1, map_l2;
-    cv::Mat map_r1, map_r2;
-    cv::Mat Q;
+    StereoCalibration calibration;
 
     void loadCalibData(const QString &fileName);
 
@@ -0,0 +1,74 @@
+#include "stereocapture.h"
+
+#include <cmath>
+#include <algorithm>
+
+StereoCapture::StereoCapture(int leftCamera, int rightCamera, QObject *parent) :
+    QObject(parent)
+{
+    captureLeft = new CaptureThread(leftCamera, &poolLeft, &ringLeft);
+    captureRight = new CaptureThread(rightCamera, &poolRight, &ringRight);
+
+    connect(captureLeft, SIGNAL(sendMessage(QString,int)), this, SIGNAL(sendMessage(QString,int)));
+    connect(captureRight, SIGNAL(sendMessage(QString,int)), this, SIGNAL(sendMessage(QString,int)));
+
+    tolerance = 20.0;
+}
+
+StereoCapture::~StereoCapture()
+{
+    delete captureLeft;
+    delete captureRight;
+}
+
+void StereoCapture::start()
+{
+    captureLeft->start();
+    captureRight->start();
+}
+
+void StereoCapture::stop()
+{
+    captureLeft->stop();
+    captureRight->stop();
+    captureLeft->wait();
+    captureRight->wait();
+}
+
+bool StereoCapture::latestPair(TimestampedFrame &left, TimestampedFrame &right) const
+{
+    TimestampedFrame latestLeft, latestRight;
+    if(!ringLeft.latest(latestLeft) || !ringRight.latest(latestRight))
+    {
+        return false;
+    }
+
+    // Anchor on the camera whose newest frame is older, its counterpart has already arrived in the other ring
+    if(latestLeft.timestamp <= latestRight.timestamp)
+    {
+        left = latestLeft;
+        ringRight.nearest(left.timestamp, right);
+    }
+    else
+    {
+        right = latestRight;
+        ringLeft.nearest(right.timestamp, left);
+    }
+
+    return std::fabs(left.timestamp - right.timestamp) <= tolerance;
+}
+
+int StereoCapture::getSpareLeases() const
+{
+    return std::min(poolLeft.capacity() - ringLeft.capacity(), poolRight.capacity() - ringRight.capacity());
+}
+
+double StereoCapture::getTolerance() const
+{
+    return tolerance;
+}
+
+void StereoCapture::setTolerance(double value)
+{
+    tolerance = value;
+}
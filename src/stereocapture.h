@@ -0,0 +1,48 @@
+#ifndef STEREOCAPTURE_H
+#define STEREOCAPTURE_H
+
+//Qt
+#include <QObject>
+
+//Local
+#include "framering.h"
+#include "framepool.h"
+#include "capturethread.h"
+
+/* Captures both cameras on their own threads and pairs left and right frames by timestamp. */
+class StereoCapture : public QObject
+{
+    Q_OBJECT
+public:
+
+    StereoCapture(int leftCamera, int rightCamera, QObject *parent = 0);
+    ~StereoCapture();
+
+    void start();
+    void stop();
+
+    bool latestPair(TimestampedFrame &left, TimestampedFrame &right) const; //most recent pair within tolerance
+
+    int getSpareLeases() const; //buffers per camera pool not held by its ring
+
+    double getTolerance() const;
+    void setTolerance(double value);
+
+private:
+
+    FramePool poolLeft; //declared before the rings so the rings release their leases first
+    FramePool poolRight;
+    FrameRing ringLeft;
+    FrameRing ringRight;
+    CaptureThread *captureLeft;
+    CaptureThread *captureRight;
+
+    double tolerance; //maximum timestamp difference of a pair in ms
+
+signals:
+
+    void sendMessage(const QString &message, int timeout);
+
+};
+
+#endif // STEREOCAPTURE_H
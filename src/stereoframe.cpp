@@ -0,0 +1,136 @@
+#include "stereoframe.h"
+
+#include <algorithm>
+
+StereoFrame::StereoFrame(const FrameLease &left, const FrameLease &right, const StereoCalibration &calibration,
+                         double timestamp, qint64 sequence)
+{
+    leaseLeft = left;
+    leaseRight = right;
+    imageLeft = left.image();
+    imageRight = right.image();
+    this->calibration = calibration;
+    this->timestamp = timestamp;
+    this->sequence = sequence;
+}
+
+StereoFrame::StereoFrame(const cv::Mat &left, const cv::Mat &right, const StereoCalibration &calibration)
+{
+    imageLeft = left;
+    imageRight = right;
+    this->calibration = calibration;
+    timestamp = 0.0;
+    sequence = -1;
+}
+
+const cv::Mat &StereoFrame::left() const
+{
+    return imageLeft;
+}
+
+const cv::Mat &StereoFrame::right() const
+{
+    return imageRight;
+}
+
+const cv::Mat &StereoFrame::grayLeft() const
+{
+    return gray(imageLeft, grayLeftImage, grayLeftMutex);
+}
+
+const cv::Mat &StereoFrame::grayRight() const
+{
+    return gray(imageRight, grayRightImage, grayRightMutex);
+}
+
+const cv::Mat &StereoFrame::pyramidLeft(int level) const
+{
+    level = std::max(0, std::min(level, (int)PyramidLevels - 1));
+    if(level == 0)
+    {
+        return grayLeft();
+    }
+
+    const cv::Mat &base = grayLeft();
+
+    QMutexLocker locker(&pyramidMutex);
+    if(pyramid[level].empty())
+    {
+        pyramid[0] = base;
+        for(int i = 1; i <= level; i++)
+        {
+            if(pyramid[i].empty())
+            {
+                cv::pyrDown(pyramid[i - 1], pyramid[i]);
+            }
+        }
+    }
+    return pyramid[level];
+}
+
+const cv::Mat &StereoFrame::rectifiedGrayLeft() const
+{
+    return rectifiedGray(imageLeft, calibration.map_l1, calibration.map_l2, rectifiedGrayLeftImage, rectifiedGrayLeftMutex);
+}
+
+const cv::Mat &StereoFrame::rectifiedGrayRight() const
+{
+    return rectifiedGray(imageRight, calibration.map_r1, calibration.map_r2, rectifiedGrayRightImage,
+                         rectifiedGrayRightMutex);
+}
+
+std::vector<cv::KeyPoint> StereoFrame::keypointsLeft() const
+{
+    QMutexLocker locker(&keypointsMutex);
+    return keypoints;
+}
+
+void StereoFrame::setKeypointsLeft(const std::vector<cv::KeyPoint> &keypoints)
+{
+    QMutexLocker locker(&keypointsMutex);
+    this->keypoints = keypoints;
+}
+
+double StereoFrame::getTimestamp() const
+{
+    return timestamp;
+}
+
+qint64 StereoFrame::getSequence() const
+{
+    return sequence;
+}
+
+const StereoCalibration &StereoFrame::getCalibration() const
+{
+    return calibration;
+}
+
+const cv::Mat &StereoFrame::gray(const cv::Mat &image, cv::Mat &grayImage, QMutex &mutex) const
+{
+    QMutexLocker locker(&mutex);
+    if(grayImage.empty() && !image.empty())
+    {
+        if(image.channels() == 1)
+        {
+            grayImage = image;
+        }
+        else
+        {
+            cv::cvtColor(image, grayImage, CV_BGR2GRAY);
+        }
+    }
+    return grayImage;
+}
+
+const cv::Mat &StereoFrame::rectifiedGray(const cv::Mat &image, const cv::Mat &map1, const cv::Mat &map2,
+                                          cv::Mat &rectifiedImage, QMutex &mutex) const
+{
+    QMutexLocker locker(&mutex);
+    if(rectifiedImage.empty() && !image.empty() && !map1.empty() && !map2.empty())
+    {
+        // Straight from the raw BGR frame, the full-size grayscale image is not needed for this
+        remapToGray(image, map1, map2, rectifiedImage);
+    }
+    return rectifiedImage;
+}
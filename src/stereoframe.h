@@ -0,0 +1,75 @@
+#ifndef STEREOFRAME_H
+#define STEREOFRAME_H
+
+//Qt
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSharedPointer>
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+
+//Local
+#include "framepool.h"
+#include "stereocalibration.h"
+#include "grayremap.h"
+
+#include <vector>
+
+/* A captured frame pair together with the images derived from it.
+ * Grayscale, pyramid and rectified views are computed on first use and memoized, so every
+ * consumer of the pair shares one conversion. Derived images are never modified once computed
+ * and may be read from any thread. */
+class StereoFrame
+{
+public:
+
+    enum { PyramidLevels = 4 };
+
+    StereoFrame(const FrameLease &left, const FrameLease &right, const StereoCalibration &calibration,
+                double timestamp = 0.0, qint64 sequence = -1);
+    StereoFrame(const cv::Mat &left, const cv::Mat &right, const StereoCalibration &calibration = StereoCalibration());
+
+    const cv::Mat &left() const; //raw BGR images
+    const cv::Mat &right() const;
+
+    const cv::Mat &grayLeft() const;
+    const cv::Mat &grayRight() const;
+
+    const cv::Mat &pyramidLeft(int level) const; //grayscale pyramid of the left image, level 0 is full size
+
+    const cv::Mat &rectifiedGrayLeft() const; //rectified grayscale, empty when no calibration is available
+    const cv::Mat &rectifiedGrayRight() const;
+
+    std::vector<cv::KeyPoint> keypointsLeft() const; //SURF keypoints of the left image, empty until the categorizer ran
+    void setKeypointsLeft(const std::vector<cv::KeyPoint> &keypoints);
+
+    double getTimestamp() const;
+    qint64 getSequence() const;
+    const StereoCalibration &getCalibration() const;
+
+private:
+
+    FrameLease leaseLeft, leaseRight; //keep pooled buffers alive as long as the frame
+    cv::Mat imageLeft, imageRight;
+    StereoCalibration calibration;
+    double timestamp;
+    qint64 sequence;
+
+    mutable QMutex grayLeftMutex, grayRightMutex, pyramidMutex, rectifiedGrayLeftMutex, rectifiedGrayRightMutex;
+    mutable cv::Mat grayLeftImage, grayRightImage;
+    mutable cv::Mat pyramid[PyramidLevels];
+    mutable cv::Mat rectifiedGrayLeftImage, rectifiedGrayRightImage;
+
+    mutable QMutex keypointsMutex;
+    std::vector<cv::KeyPoint> keypoints;
+
+    const cv::Mat &gray(const cv::Mat &image, cv::Mat &grayImage, QMutex &mutex) const;
+    const cv::Mat &rectifiedGray(const cv::Mat &image, const cv::Mat &map1, const cv::Mat &map2,
+                                 cv::Mat &rectifiedImage, QMutex &mutex) const;
+
+};
+
+typedef QSharedPointer<StereoFrame> StereoFramePtr;
+
+#endif // STEREOFRAME_H
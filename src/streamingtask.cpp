@@ -0,0 +1,136 @@
+#include "streamingtask.h"
+
+/* Task processing the next input of a StreamingTask, the owner outlives it since it waits for it. */
+class StreamingTask::Runner : public Task
+{
+public:
+
+    Runner(StreamingTask *owner, Priority priority) : Task(priority), owner(owner)
+    {
+    }
+
+protected:
+
+    void run()
+    {
+        owner->runNext();
+    }
+
+private:
+
+    StreamingTask *owner;
+};
+
+StreamingTask::StreamingTask(Task::Priority priority)
+{
+    this->priority = priority;
+    serial = false;
+    running = false;
+    resumeAt = 0;
+    clock.start();
+}
+
+StreamingTask::~StreamingTask()
+{
+    // Last resort only, process() of a derived class may already be using destroyed members here
+    stop();
+    wait();
+}
+
+void StreamingTask::start()
+{
+    QMutexLocker locker(&inputMutex);
+    running = true;
+    resumeAt = 0;
+    schedule();
+}
+
+void StreamingTask::stop()
+{
+    QMutexLocker locker(&inputMutex);
+    running = false;
+    clearPending();
+}
+
+bool StreamingTask::isRunning() const
+{
+    QMutexLocker locker(&inputMutex);
+    return running;
+}
+
+bool StreamingTask::isSerial() const
+{
+    QMutexLocker locker(&inputMutex);
+    return serial;
+}
+
+void StreamingTask::setSerial(bool value)
+{
+    QMutexLocker locker(&inputMutex);
+    serial = value;
+}
+
+void StreamingTask::wait()
+{
+    // A finishing task may have queued the next one
+    while(1)
+    {
+        TaskPtr pending;
+        {
+            QMutexLocker locker(&inputMutex);
+            pending = task;
+        }
+
+        if(pending.isNull())
+        {
+            return;
+        }
+        TaskScheduler::instance()->wait(pending);
+    }
+}
+
+void StreamingTask::schedule()
+{
+    // One task at a time keeps the inputs in order, a deferred input is taken once stored after the delay
+    if(!running || !task.isNull() || !hasPending() || clock.elapsed() < resumeAt)
+    {
+        return;
+    }
+
+    task = TaskPtr(new Runner(this, priority));
+    task->setSerial(serial);
+    TaskScheduler::instance()->submit(task);
+}
+
+void StreamingTask::defer(qint64 ms)
+{
+    QMutexLocker locker(&inputMutex);
+    resumeAt = clock.elapsed() + ms;
+}
+
+void StreamingTask::runNext()
+{
+    {
+        QMutexLocker locker(&inputMutex);
+        if(!running || !hasPending())
+        {
+            task.clear();
+            return;
+        }
+        takePending();
+    }
+
+    try
+    {
+        process();
+    }
+    catch(...)
+    {
+        qWarning("Input dropped by an exception");
+    }
+
+    // The next input gets a task of its own, so a steady stream does not hold on to one worker
+    QMutexLocker locker(&inputMutex);
+    task.clear();
+    schedule();
+}
@@ -0,0 +1,61 @@
+#ifndef STREAMINGTASK_H
+#define STREAMINGTASK_H
+
+//Qt
+#include <QObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+
+//Local
+#include "taskscheduler.h"
+
+/* Base of the persistent workers fed from the GUI at camera rate.
+ * A derived class keeps its pending input under inputMutex and calls schedule() once it has stored a new
+ * one. Inputs are handed to process() one at a time in tasks on the shared TaskScheduler, so no thread
+ * waits for input; an input stored while another one is processed is taken by the next task.
+ * start(), stop(), isRunning() and wait() keep the API of the QThread workers they replace. */
+class StreamingTask : public QObject
+{
+    Q_OBJECT
+public:
+
+    StreamingTask(Task::Priority priority = Task::Interactive);
+    virtual ~StreamingTask(); //as with QThread, stop() and wait() before deleting
+
+    void start(); //inputs are processed from now on
+    void stop(); //drops the pending input, the one being processed is finished
+    bool isRunning() const; //started and not stopped
+    void wait(); //after stop(), until no input is processed any more
+
+    bool isSerial() const;
+    void setSerial(bool value); //process() runs its parallel loops on its own worker only, see Task::setSerial()
+
+protected:
+
+    mutable QMutex inputMutex; //pending input of the derived class and the scheduling state
+
+    void schedule(); //with inputMutex held, after a new input was stored
+    void defer(qint64 ms); //from process(), no input is taken for the next ms
+
+    virtual bool hasPending() const = 0; //with inputMutex held
+    virtual void takePending() = 0; //with inputMutex held, moves the pending input to the one processed
+    virtual void clearPending() = 0; //with inputMutex held
+    virtual void process() = 0; //processes the taken input without inputMutex
+
+private:
+
+    class Runner;
+
+    Task::Priority priority;
+    bool serial;
+    bool running;
+    TaskPtr task; //queued or running task, null while no input is processed
+    QElapsedTimer clock;
+    qint64 resumeAt; //ms of clock before which no input is taken
+
+    void runNext();
+
+};
+
+#endif // STREAMINGTASK_H
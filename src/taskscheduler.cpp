@@ -0,0 +1,428 @@
+#include "taskscheduler.h"
+
+//Qt
+#include <QtGlobal>
+
+#include <algorithm>
+
+Task::Task(Priority priority)
+{
+    this->priority = priority;
+    serial = false;
+    pendingDependencies = 0;
+}
+
+Task::~Task()
+{
+}
+
+Task::Priority Task::getPriority() const
+{
+    return priority;
+}
+
+bool Task::isFinished() const
+{
+    return finished.loadAcquire() != 0;
+}
+
+bool Task::isSerial() const
+{
+    return serial;
+}
+
+void Task::setSerial(bool value)
+{
+    serial = value;
+}
+
+/* Pool thread with its own deque of tasks per priority. */
+class TaskScheduler::Worker : public QThread
+{
+public:
+
+    Worker(TaskScheduler *scheduler, int index) :
+        scheduler(scheduler), index(index), current(Task::Interactive), serial(false)
+    {
+    }
+
+    TaskScheduler *scheduler;
+    int index;
+    Task::Priority current; //priority of the task being run, helping a waiting task keeps to it
+    bool serial; //the task being run keeps its loops on this worker
+
+    QMutex mutex;
+    QList<TaskPtr> deque[Task::PriorityCount];
+
+protected:
+
+    void run()
+    {
+        while(!scheduler->stopping)
+        {
+            quint64 seen = scheduler->currentGeneration();
+
+            TaskPtr task;
+            if(scheduler->take(this, false, task))
+            {
+                scheduler->execute(this, task);
+            }
+            else
+            {
+                scheduler->idle(seen);
+            }
+        }
+    }
+};
+
+/* Part of a parallelFor() range, an exception is kept for the caller instead of ending the task. */
+class TaskScheduler::LoopPart : public Task
+{
+public:
+
+    LoopPart(const cv::ParallelLoopBody &body, const cv::Range &range, Priority priority) :
+        Task(priority), body(body), range(range), failed(false)
+    {
+    }
+
+    const cv::ParallelLoopBody &body; //owned by the caller of parallelFor(), which waits for the part
+    cv::Range range;
+    bool failed;
+    cv::Exception error;
+
+protected:
+
+    void run()
+    {
+        try
+        {
+            body(range);
+        }
+        catch(const cv::Exception &e)
+        {
+            error = e;
+            failed = true;
+        }
+    }
+};
+
+TaskScheduler::TaskScheduler(int workers)
+{
+    // One worker is kept free of background work, so at least two are needed
+    int count = std::max(2, workers);
+    maxBackground = count - 1;
+    runningBackground = 0;
+    generation = 0;
+    stopping = false;
+
+    // A second pool of the same size inside the tasks would oversubscribe the cores
+    cv::setNumThreads(0);
+
+    for(int i = 0; i < count; i++)
+    {
+        this->workers.push_back(new Worker(this, i));
+    }
+    for(int i = 0; i < count; i++)
+    {
+        this->workers[i]->start();
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    stopping = true;
+    notify();
+
+    for(size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i]->wait();
+        delete workers[i];
+    }
+}
+
+TaskScheduler *TaskScheduler::instance()
+{
+    static TaskScheduler scheduler;
+    return &scheduler;
+}
+
+void TaskScheduler::submit(const TaskPtr &task, const QList<TaskPtr> &dependencies)
+{
+    {
+        QMutexLocker locker(&graphMutex);
+        task->pendingDependencies = 0;
+        for(int i = 0; i < dependencies.size(); i++)
+        {
+            if(!dependencies[i]->isFinished())
+            {
+                dependencies[i]->dependents.append(task);
+                task->pendingDependencies++;
+            }
+        }
+
+        // Queued by the last dependency to finish
+        if(task->pendingDependencies > 0)
+        {
+            return;
+        }
+    }
+
+    enqueue(task);
+}
+
+void TaskScheduler::wait(const TaskPtr &task)
+{
+    Worker *worker = currentWorker();
+
+    while(!task->isFinished())
+    {
+        // Blocking a worker could deadlock the pool when the task is still queued, run it or others instead
+        TaskPtr other;
+        if(worker != NULL && take(worker, true, other))
+        {
+            execute(worker, other);
+            continue;
+        }
+
+        QMutexLocker locker(&graphMutex);
+        if(!task->isFinished())
+        {
+            finishedCondition.wait(&graphMutex, worker != NULL ? 10 : 100);
+        }
+    }
+}
+
+void TaskScheduler::parallelFor(const cv::Range &range, const cv::ParallelLoopBody &body)
+{
+    int length = range.end - range.start;
+    int usable = parallelism();
+    if(length <= 1 || usable == 1)
+    {
+        body(range);
+        return;
+    }
+
+    // A few parts per worker balance uneven parts, stealing takes care of the rest
+    int parts = std::min(length, 4 * usable);
+
+    Worker *worker = currentWorker();
+    Task::Priority priority = worker != NULL ? worker->current : Task::Interactive;
+
+    QList<QSharedPointer<LoopPart> > tasks;
+    for(int i = 1; i < parts; i++)
+    {
+        cv::Range part(range.start + (int)((qint64)length * i / parts),
+                       range.start + (int)((qint64)length * (i + 1) / parts));
+        tasks.append(QSharedPointer<LoopPart>(new LoopPart(body, part, priority)));
+        submit(tasks.last());
+    }
+
+    // The parts reference body, so they are all waited for even if the caller's part throws
+    bool failed = false;
+    cv::Exception error;
+    try
+    {
+        body(cv::Range(range.start, range.start + length / parts));
+    }
+    catch(const cv::Exception &e)
+    {
+        error = e;
+        failed = true;
+    }
+    catch(...)
+    {
+        for(int i = 0; i < tasks.size(); i++)
+        {
+            wait(tasks[i]);
+        }
+        throw;
+    }
+
+    for(int i = 0; i < tasks.size(); i++)
+    {
+        wait(tasks[i]);
+        if(!failed && tasks[i]->failed)
+        {
+            error = tasks[i]->error;
+            failed = true;
+        }
+    }
+
+    if(failed)
+    {
+        throw error;
+    }
+}
+
+int TaskScheduler::workerCount() const
+{
+    return workers.size();
+}
+
+int TaskScheduler::parallelism() const
+{
+    Worker *worker = currentWorker();
+    return worker != NULL && worker->serial ? 1 : workers.size();
+}
+
+TaskScheduler::Worker *TaskScheduler::currentWorker() const
+{
+    Worker *worker = dynamic_cast<Worker*>(QThread::currentThread());
+    return worker != NULL && worker->scheduler == this ? worker : NULL;
+}
+
+void TaskScheduler::enqueue(const TaskPtr &task)
+{
+    Worker *worker = currentWorker();
+    if(worker != NULL)
+    {
+        QMutexLocker locker(&worker->mutex);
+        worker->deque[task->getPriority()].append(task);
+    }
+    else
+    {
+        QMutexLocker locker(&queueMutex);
+        queue[task->getPriority()].append(task);
+    }
+
+    notify();
+}
+
+bool TaskScheduler::take(Worker *worker, bool helping, TaskPtr &task)
+{
+    if(takeFrom(worker, Task::Interactive, task))
+    {
+        return true;
+    }
+
+    // An interactive task waiting for its subtasks must not be held up by training, and a worker
+    // helping a background task already holds a background slot
+    if(helping && worker->current == Task::Interactive)
+    {
+        return false;
+    }
+
+    QMutexLocker locker(&backgroundMutex);
+    bool lent = helping;
+    if(!lent && runningBackground >= maxBackground)
+    {
+        return false;
+    }
+
+    if(!takeFrom(worker, Task::Background, task))
+    {
+        return false;
+    }
+    runningBackground++;
+    return true;
+}
+
+bool TaskScheduler::takeFrom(Worker *worker, Task::Priority priority, TaskPtr &task)
+{
+    // Own tasks newest first, they are likely to share data with the one just finished
+    {
+        QMutexLocker locker(&worker->mutex);
+        if(!worker->deque[priority].isEmpty())
+        {
+            task = worker->deque[priority].takeLast();
+            return true;
+        }
+    }
+
+    {
+        QMutexLocker locker(&queueMutex);
+        if(!queue[priority].isEmpty())
+        {
+            task = queue[priority].takeFirst();
+            return true;
+        }
+    }
+
+    // Steal the oldest task of another worker
+    for(size_t i = 1; i < workers.size(); i++)
+    {
+        Worker *victim = workers[(worker->index + i) % workers.size()];
+        QMutexLocker locker(&victim->mutex);
+        if(!victim->deque[priority].isEmpty())
+        {
+            task = victim->deque[priority].takeFirst();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TaskScheduler::execute(Worker *worker, const TaskPtr &task)
+{
+    Task::Priority previous = worker->current;
+    bool previousSerial = worker->serial;
+    worker->current = task->getPriority();
+    worker->serial = task->isSerial();
+
+    try
+    {
+        task->run();
+    }
+    catch(...)
+    {
+        qWarning("Task terminated by an exception");
+    }
+
+    worker->current = previous;
+    worker->serial = previousSerial;
+
+    if(task->getPriority() == Task::Background)
+    {
+        QMutexLocker locker(&backgroundMutex);
+        runningBackground--;
+    }
+
+    QList<TaskPtr> ready;
+    {
+        QMutexLocker locker(&graphMutex);
+        task->finished.storeRelease(1);
+        for(int i = 0; i < task->dependents.size(); i++)
+        {
+            if(--task->dependents[i]->pendingDependencies == 0)
+            {
+                ready.append(task->dependents[i]);
+            }
+        }
+        task->dependents.clear();
+        finishedCondition.wakeAll();
+    }
+
+    for(int i = 0; i < ready.size(); i++)
+    {
+        enqueue(ready[i]);
+    }
+
+    // A freed background slot may let a queued background task run
+    if(task->getPriority() == Task::Background)
+    {
+        notify();
+    }
+}
+
+void TaskScheduler::notify()
+{
+    QMutexLocker locker(&idleMutex);
+    generation++;
+    idleCondition.wakeAll();
+}
+
+quint64 TaskScheduler::currentGeneration()
+{
+    QMutexLocker locker(&idleMutex);
+    return generation;
+}
+
+void TaskScheduler::idle(quint64 seenGeneration)
+{
+    QMutexLocker locker(&idleMutex);
+    if(generation == seenGeneration && !stopping)
+    {
+        idleCondition.wait(&idleMutex, 100);
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+//Qt
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QSharedPointer>
+#include <QList>
+#include <QAtomicInt>
+
+//OpenCV
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+/* Unit of work run by the TaskScheduler. */
+class Task
+{
+public:
+
+    enum Priority { Interactive, Background, PriorityCount };
+
+    Task(Priority priority = Interactive);
+    virtual ~Task();
+
+    Priority getPriority() const;
+    bool isFinished() const;
+
+    bool isSerial() const;
+    void setSerial(bool value); //parallelFor() calls of a serial task run on its own worker only, set before submitting
+
+protected:
+
+    virtual void run() = 0;
+
+private:
+
+    friend class TaskScheduler;
+
+    Priority priority;
+    bool serial;
+    QAtomicInt finished;
+    int pendingDependencies; //guarded by the graph mutex of the scheduler
+    QList<QSharedPointer<Task> > dependents;
+
+};
+
+typedef QSharedPointer<Task> TaskPtr;
+
+/* Work-stealing pool shared by the processing pipeline and the batch jobs.
+ * Every worker has its own deque per priority: tasks submitted from a worker are pushed onto its deque and
+ * popped LIFO, idle workers steal FIFO from the others, tasks from other threads go to a shared queue.
+ * Interactive tasks are always taken before background ones, and background tasks never occupy more than
+ * all workers but one, so a frame arriving during training finds a free worker.
+ * A task submitted with dependencies is queued once all of them have finished.
+ * The pool is the only source of parallelism: loops are split with parallelFor() instead of cv::parallel_for_,
+ * and OpenCV's own thread pool is switched off so its functions run serially inside the tasks. */
+class TaskScheduler
+{
+public:
+
+    TaskScheduler(int workers = QThread::idealThreadCount());
+    ~TaskScheduler();
+
+    static TaskScheduler *instance(); //pool shared by the whole application
+
+    void submit(const TaskPtr &task, const QList<TaskPtr> &dependencies = QList<TaskPtr>());
+    void wait(const TaskPtr &task); //a waiting worker runs other tasks meanwhile
+
+    // Runs body over range split into tasks of the caller's priority and returns once all are done,
+    // the calling thread runs a part itself. A cv::Exception thrown by any part is rethrown.
+    void parallelFor(const cv::Range &range, const cv::ParallelLoopBody &body);
+
+    int workerCount() const;
+    int parallelism() const; //workers a parallelFor() of the calling thread can use, 1 inside a serial task
+
+private:
+
+    class Worker;
+    friend class Worker;
+    class LoopPart;
+
+    std::vector<Worker*> workers;
+    int maxBackground; //background tasks running at the same time
+
+    QMutex queueMutex; //shared queue of tasks submitted from outside the pool
+    QList<TaskPtr> queue[Task::PriorityCount];
+
+    QMutex graphMutex; //dependencies and completion of all tasks
+    QWaitCondition finishedCondition;
+
+    QMutex backgroundMutex;
+    int runningBackground;
+
+    QMutex idleMutex;
+    QWaitCondition idleCondition;
+    quint64 generation; //bumped whenever new work may be available
+    volatile bool stopping;
+
+    Worker *currentWorker() const;
+    void enqueue(const TaskPtr &task);
+    bool take(Worker *worker, bool helping, TaskPtr &task);
+    bool takeFrom(Worker *worker, Task::Priority priority, TaskPtr &task);
+    void execute(Worker *worker, const TaskPtr &task);
+    void notify();
+    quint64 currentGeneration();
+    void idle(quint64 seenGeneration);
+
+};
+
+#endif // TASKSCHEDULER_H
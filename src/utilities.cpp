@@ -5,19 +5,32 @@
 #include <QMessageBox>
 #include <QTimer>
 #include <QDebug>
+#include <QGuiApplication>
+#include <QScreen>
 
 //Local
 #include "utilities.h"
+#include "adaptivesurfdetector.h"
+
+#include <algorithm>
+
+#if defined(__SSSE3__) || (defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64)))
+#include <tmmintrin.h>
+#define SORDE_SSSE3
+#endif
 
 QImage MatToQImage(const cv::Mat &mat)
 {
     // 8-bits unsigned, NO. OF CHANNELS=1
         if(mat.type()==CV_8UC1)
         {
-            // Set the color table (used to translate colour indexes to qRgb values)
-            QVector<QRgb> colorTable;
-            for (int i=0; i<256; i++)
-                colorTable.push_back(qRgb(i,i,i));
+            // Set the color table (used to translate colour indexes to qRgb values), built only once
+            static QVector<QRgb> colorTable;
+            if(colorTable.isEmpty())
+            {
+                for (int i=0; i<256; i++)
+                    colorTable.push_back(qRgb(i,i,i));
+            }
             // Copy input Mat
             const uchar *qImageBuffer = (const uchar*)mat.data;
             // Create QImage with same dimensions as input Mat
@@ -28,11 +41,11 @@ QImage MatToQImage(const cv::Mat &mat)
         // 8-bits unsigned, NO. OF CHANNELS=3
         else if(mat.type()==CV_8UC3)
         {
-            // Copy input Mat
-            const uchar *qImageBuffer = (const uchar*)mat.data;
-            // Create QImage with same dimensions as input Mat
-            QImage img(qImageBuffer, mat.cols, mat.rows, mat.step, QImage::Format_RGB888);
-            return img.rgbSwapped();
+            // Convert straight into the native 32-bit format instead of wrapping and swapping
+            QImage img(mat.cols, mat.rows, QImage::Format_RGB32);
+            cv::Mat buffer(img.height(), img.width(), CV_8UC4, img.bits(), img.bytesPerLine());
+            bgrToRgb32(mat, buffer);
+            return img;
         }
         else
         {
@@ -42,6 +55,63 @@ QImage MatToQImage(const cv::Mat &mat)
 }
 
 
+void bgrToRgb32(const cv::Mat &src, cv::Mat &dst)
+{
+    // A dst wrapping a QImage of the right size is written in place
+    dst.create(src.size(), CV_8UC4);
+
+    if(src.type() == CV_8UC1)
+    {
+        cv::cvtColor(src, dst, CV_GRAY2BGRA);
+        return;
+    }
+    CV_Assert(src.type() == CV_8UC3);
+
+    // Format_RGB32 is 0xffRRGGBB, i.e. B, G, R, 0xff in memory, so BGR only needs the alpha byte inserted
+#ifdef SORDE_SSSE3
+    bool ssse3 = cv::checkHardwareSupport(CV_CPU_SSSE3);
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+#endif
+
+    for(int y = 0; y < src.rows; y++)
+    {
+        const uchar *s = src.ptr<uchar>(y);
+        uchar *d = dst.ptr<uchar>(y);
+        int x = 0;
+
+#ifdef SORDE_SSSE3
+        if(ssse3)
+        {
+            // Each 16-byte load covers 4 pixels and part of the next, stop while it stays inside the row
+            for(; x + 6 <= src.cols; x += 4)
+            {
+                __m128i pixels = _mm_loadu_si128((const __m128i*)(s + 3 * x));
+                _mm_storeu_si128((__m128i*)(d + 4 * x), _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha));
+            }
+        }
+#endif
+
+        for(; x < src.cols; x++)
+        {
+            d[4 * x] = s[3 * x];
+            d[4 * x + 1] = s[3 * x + 1];
+            d[4 * x + 2] = s[3 * x + 2];
+            d[4 * x + 3] = 255;
+        }
+    }
+}
+
+int displayRefreshInterval()
+{
+    QScreen *screen = QGuiApplication::primaryScreen();
+    if(screen == NULL || screen->refreshRate() <= 0.0)
+    {
+        return 16;
+    }
+    return qMax(1, qRound(1000.0 / screen->refreshRate()));
+}
+
 cv::Mat QImageToMat(QImage const& src)
 {
      cv::Mat tmp(src.height(),src.width(),CV_8UC3,(uchar*)src.bits(),src.bytesPerLine());
@@ -148,7 +218,7 @@ void generateKpDesc(cv::Mat img, std::vector<cv::KeyPoint> &kp, cv::Mat &desc)
     cv::Ptr<cv::FeatureDetector> featureDetector;
     cv::Ptr<cv::DescriptorExtractor> descriptorExtractor;
 
-    featureDetector = new cv::SurfFeatureDetector(500);
+    featureDetector = new cv::SurfFeatureDetector(defaultHessianThreshold);
     descriptorExtractor = new cv::SurfDescriptorExtractor();
 
     featureDetector -> detect(img, kp);
@@ -166,22 +236,77 @@ void addDirectory(QString dirName)
     }
 }
 
-void detectChessboard(const cv::Mat &frame, cv::Size patternSize)
+bool findChessboard(const cv::Mat &gray, cv::Size patternSize, std::vector<cv::Point2f> &corners, cv::Size subPixWindow)
 {
-    cv::Mat gray; //source image
-    cv::cvtColor(frame, gray, CV_BGR2GRAY);
-    std::vector<cv::Point2f> corners; //this will be filled by the detected corners
-
     //CALIB_CB_FAST_CHECK saves a lot of time on images
     //that do not contain any chessboard corners
-    bool patternFound = cv::findChessboardCorners(gray, patternSize, corners,
-                                                  cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE +
-                                                  cv::CALIB_CB_FAST_CHECK);
+    const int flags = cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE + cv::CALIB_CB_FAST_CHECK;
+
+    //Search large images at about VGA width first, the board is still found there in most views
+    const int searchWidth = 640;
+    bool patternFound = false;
+
+    if(gray.cols > searchWidth * 3 / 2)
+    {
+        double scale = (double)gray.cols / searchWidth;
+        cv::Mat small;
+        cv::resize(gray, small, cv::Size(), 1.0 / scale, 1.0 / scale, cv::INTER_AREA);
+
+        patternFound = cv::findChessboardCorners(small, patternSize, corners, flags);
+        if(patternFound)
+        {
+            for(size_t i = 0; i < corners.size(); i++)
+            {
+                corners[i] = (corners[i] + cv::Point2f(0.5f, 0.5f)) * (float)scale - cv::Point2f(0.5f, 0.5f);
+            }
+
+            //The refinement window has to reach the true corner from the scaled-up estimate
+            int reach = cvCeil(scale * 2.0);
+            subPixWindow = cv::Size(std::max(subPixWindow.width, reach), std::max(subPixWindow.height, reach));
+        }
+    }
+
+    //Full resolution only for small images or when the fast pass failed
+    if(!patternFound)
+    {
+        patternFound = cv::findChessboardCorners(gray, patternSize, corners, flags);
+    }
 
     if(patternFound)
     {
-      cv::cornerSubPix(gray, corners, cv::Size(11, 11), cv::Size(-1, -1),
+      cv::cornerSubPix(gray, corners, subPixWindow, cv::Size(-1, -1),
                        cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1));
     }
+    return patternFound;
+}
+
+void detectChessboard(const cv::Mat &frame, cv::Size patternSize)
+{
+    cv::Mat gray; //source image
+    cv::cvtColor(frame, gray, CV_BGR2GRAY);
+    detectChessboard(frame, gray, patternSize);
+}
+
+void detectChessboard(const cv::Mat &frame, const cv::Mat &gray, cv::Size patternSize)
+{
+    std::vector<cv::Point2f> corners; //this will be filled by the detected corners
+    bool patternFound = findChessboard(gray, patternSize, corners, cv::Size(11, 11));
     cv::drawChessboardCorners(frame, patternSize, cv::Mat(corners), patternFound);
 }
+
+void initWebcamBlockMatcher(cv::StereoBM &stereo, int SADWindowSize)
+{
+    // Normalized response pre-filter copes with the exposure differences of the two webcams,
+    // the texture threshold rejects the flat areas BM cannot match
+    stereo.state->preFilterType = CV_STEREO_BM_NORMALIZED_RESPONSE;
+    stereo.state->preFilterSize = 9;
+    stereo.state->preFilterCap = 31;
+    stereo.state->SADWindowSize = SADWindowSize;
+    stereo.state->textureThreshold = 10;
+    stereo.state->uniquenessRatio = 15;
+}
+
+double captureTimestamp()
+{
+    return cv::getTickCount() * 1000.0 / cv::getTickFrequency();
+}
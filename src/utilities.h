@@ -14,6 +14,8 @@
 
 
 QImage MatToQImage(const cv::Mat& mat); //Convert opencv matrix to qimage
+void bgrToRgb32(const cv::Mat &src, cv::Mat &dst); //Convert BGR or gray to QImage::Format_RGB32 layout in a single pass
+int displayRefreshInterval(); //Timer interval in ms matching the refresh rate of the primary screen
 cv::Mat QImageToMat(const QImage &src); //Convert QImage to cv::Mat
 void loadDictionary(QWidget *parent, QString dataDirName, cv::Mat &vocab, QMap<QString, cv::SVM> &svms); //Load dictionary
 void loadTemplateImages(QString dataDirName, QList<QString> &categoryNames, QMap<QString, cv::Mat> &templates);
@@ -24,6 +26,13 @@ void generateTemplateFeatures(QWidget *parent, QString dataDirName, QList<QStrin
 void generateKpDesc(cv::Mat img, std::vector<cv::KeyPoint> &kp, cv::Mat &desc);
 void addDirectory(QString dirName);
 
+bool findChessboard(const cv::Mat &gray, cv::Size patternSize, std::vector<cv::Point2f> &corners,
+                    cv::Size subPixWindow = cv::Size(5, 5)); //Find chessboard corners and refine them to sub-pixel accuracy
 void detectChessboard(const cv::Mat &frame, cv::Size patternSize); //Function to detect and draw chessboard corners
+void detectChessboard(const cv::Mat &frame, const cv::Mat &gray, cv::Size patternSize); //Same, reusing a grayscale view of frame
+
+void initWebcamBlockMatcher(cv::StereoBM &stereo, int SADWindowSize); //StereoBM pre-filter and validity settings for the two webcams
+
+double captureTimestamp(); //Monotonic time in ms, shared by all capture threads
 
 #endif // UTILITIES_H